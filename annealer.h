@@ -0,0 +1,441 @@
+//---------------------------------------------------------------------------
+#ifndef annealerH
+#define annealerH
+//---------------------------------------------------------------------------
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+#include <vector>
+#include <iostream>
+#include "fplan.h"
+#include "schedule.h"
+#include "checkpoint.h"
+#include "telemetry.h"
+#include "memstat.h"
+#include "trajectory.h"
+//---------------------------------------------------------------------------
+#include <csignal>
+
+// Budgets of one anneal; 0 means unlimited.
+extern double time_limit;                   // wall-clock seconds
+extern long   max_moves;
+extern bool   compress_schedule;            // cool faster to fit the budget
+extern volatile sig_atomic_t sa_interrupted; // set by SIGINT/SIGTERM
+
+// Outcome of the last anneal, for reports.
+struct SA_Result{
+  int    stop;          // SA_Stop
+  long   moves;         // moves tried
+  long   best_move;     // move that found the best solution
+  double best_wall;     // wall-clock seconds to the best solution
+  double wall;          // wall-clock seconds of the anneal
+};
+extern SA_Result sa_result;
+
+/* Simulated annealing driver shared by the B*-tree and QB-tree engines.
+
+   Problem (called directly, so the move loop has no virtual dispatch):
+     int    size()       modules; k*size() moves are tried per temperature
+     double start()      pack and keep the initial solution, return its cost
+     double move()       perturb and pack, return the new cost
+     void   accept()     keep the current solution as the last one
+     void   reject()     recover the last solution
+     void   keep_best()  keep the current solution as the best one
+     void   finish()     recover the best solution and pack it
+     double area(), wirelength()
+     bool   check()      sanity check of a new best solution
+     void   save(Blob&)  append the current, last and best solutions
+     bool   load(Blob&)  restore them, false if the image does not fit
+     const char* step_fields()
+                         JSON members on the temperature step just ended,
+                         for the telemetry ("" for none)
+
+   Schedule: see schedule.h.
+
+   The run also ends when a budget (time_limit, max_moves) runs out or the
+   process is told to stop; the best solution found so far is recovered
+   either way, so the caller can always write it out.
+
+   With checkpoint_file set, the state at the end of a temperature step
+   (where the current solution is the last one) is written every
+   checkpoint_every seconds, and once more when a budget or a signal stops
+   the run. Resuming from it replays the rest of the run exactly: the
+   schedule, counters and random number generator are part of the image.
+*/
+template<class Problem, class Schedule>
+class Annealer{
+  public:
+    Annealer(Problem &p, Schedule &s) : fp(p), sched(s) {}
+
+    // k: factor of the number of permutation in one temperature
+    // returns the time the best solution was found
+    double run(int k);
+
+    int good_num, bad_num, reject_num;
+    long moves;         // moves tried in total
+    long best_move;     // move that found the best solution
+    double best_wall;   // wall-clock seconds into the run of the best
+    int stop;
+
+  private:
+    int    budget(long done);
+    double used(long done);
+    void   save(Blob &b, const TempStep &step, double pre_cost, double best);
+    bool   load(Blob &b, TempStep &step, double &pre_cost, double &best);
+
+    Problem  &fp;
+    Schedule &sched;
+    double   wall_start;
+};
+
+// Reason to stop early after "done" moves, or SA_RUNNING.
+template<class Problem, class Schedule>
+inline int Annealer<Problem,Schedule>::budget(long done)
+{
+  if(sa_interrupted)
+    return SA_INTERRUPTED;
+  if(max_moves > 0 && done >= max_moves)
+    return SA_MOVE_LIMIT;
+  if(time_limit > 0 && wall_seconds() - wall_start >= time_limit)
+    return SA_TIME_LIMIT;
+  return SA_RUNNING;
+}
+
+// Fraction of the tighter budget used after "done" moves, 0 if none.
+template<class Problem, class Schedule>
+double Annealer<Problem,Schedule>::used(long done)
+{
+  double f=0;
+  if(max_moves > 0)
+    f = max(f, double(done)/max_moves);
+  if(time_limit > 0)
+    f = max(f, (wall_seconds() - wall_start)/time_limit);
+  return f;
+}
+
+template<class Problem, class Schedule>
+void Annealer<Problem,Schedule>::save(Blob &b, const TempStep &step,
+                                      double pre_cost, double best)
+{
+  b.put(checkpoint_magic);
+  b.put(checkpoint_version);
+  b.put(int(Schedule::id));
+  b.put(int(sizeof(Schedule)));
+  b.put(sched);
+  b.put(step);
+  b.put(pre_cost);
+  b.put(best);
+  b.put(good_num);
+  b.put(bad_num);
+  b.put(moves);
+  b.put(best_move);
+  b.put(best_wall);
+  b.put(wall_seconds() - wall_start);
+  b.put(rand_get_state());
+  fp.save(b);
+}
+
+template<class Problem, class Schedule>
+bool Annealer<Problem,Schedule>::load(Blob &b, TempStep &step,
+                                      double &pre_cost, double &best)
+{
+  unsigned magic, version;
+  int id, size;
+  double wall;
+  uint64_t state;
+
+  if(!b.get(magic) || magic != checkpoint_magic ||
+     !b.get(version) || version != checkpoint_version)
+    return false;
+  if(!b.get(id) || !b.get(size))
+    return false;
+  if(id != Schedule::id || size != sizeof(Schedule)){
+    printf("checkpoint was written with --schedule=%s\n",
+           id >= 0 && id <= SCHED_GEOMETRIC ? schedule_name(id) : "?");
+    return false;
+  }
+  if(!b.get(sched) || !b.get(step) || !b.get(pre_cost) || !b.get(best) ||
+     !b.get(good_num) || !b.get(bad_num) || !b.get(moves) ||
+     !b.get(best_move) || !b.get(best_wall) || !b.get(wall) ||
+     !b.get(state))
+    return false;
+  if(!fp.load(b))
+    return false;
+
+  rand_set_state(state);
+  wall_start = wall_seconds() - wall;   // budgets count the earlier part
+  return true;
+}
+
+template<class Problem, class Schedule>
+double Annealer<Problem,Schedule>::run(int k)
+{
+  int MT,uphill,reject;
+  double pre_cost,best,cost;
+  float d_cost;
+
+  int N = k * fp.size();
+  double time=seconds();
+  wall_start = wall_seconds();
+  best_wall = 0;
+  stop = SA_RUNNING;
+  TempStep step;
+
+  if(resume_file[0]){
+    Blob image;
+    if(!image.read(resume_file) || !load(image, step, pre_cost, best))
+      error("unable to resume from checkpoint: %s", resume_file);
+    printf("Resumed from %s after iteration %d, moves = %ld\n",
+           resume_file, step.count, moves);
+  }
+  else{
+    sched.start();
+
+    // get inital solution
+    pre_cost = best = fp.start();
+
+    good_num=bad_num=0;
+    moves=best_move=0;
+    step.count=0;
+    step.reject=0;
+  }
+  reject = step.reject;
+  if(trajectory.recording())
+    trajectory.header.start_cost = pre_cost;
+
+  CheckpointWriter *writer = nullptr;
+  Blob image;                   // state after the last finished step
+  bool image_sent = true;
+  double last_write = wall_seconds();
+  if(checkpoint_file[0])
+    writer = new CheckpointWriter(checkpoint_file);
+
+  while(true){
+    step.count++;
+    MT=uphill=reject=0;
+    float step_T = sched.actual_T;
+
+    RunningStats costs, deltas;
+    double best_delta=0;
+    double up_sum=0;
+    int up_num=0;
+    for(; uphill < N && MT < 2*N; MT++){
+      if((stop = budget(moves + MT)))
+        break;
+
+      if(trajectory.recording())
+        trajectory.begin(rand_get_state());
+      cost = fp.move();
+      d_cost = cost - pre_cost;
+      float p = exp(d_cost/sched.T);
+
+      costs.add(cost);
+      deltas.add(d_cost);
+      if(d_cost < best_delta)
+        best_delta = d_cost;
+      if(d_cost > 0)
+        up_sum += d_cost, up_num++;
+
+      bool accept = d_cost <=0 || rand_01() < p;
+      if(trajectory.recording())
+        trajectory.end(d_cost, accept);
+
+      if(accept){
+        fp.accept();
+        pre_cost = cost;
+
+        if(d_cost > 0)
+          uphill++, bad_num++;
+        else if(d_cost < 0)  good_num++;
+
+        // keep best solution
+        if(cost < best){
+          fp.keep_best();
+          best = cost;
+          assert(fp.check());
+          time = seconds();
+          best_move = moves + MT + 1;
+          best_wall = wall_seconds() - wall_start;
+          if(telemetry.enabled())
+            telemetry.new_best(best_move, best, fp.area(), fp.wirelength(),
+                               best_wall);
+        }
+      }
+      else{
+        reject++;
+        fp.reject();
+      }
+    }
+
+    moves += MT;
+    if(stop)
+      break;
+
+    step.moves = MT;
+    step.uphill = uphill;
+    step.reject = reject;
+    step.cost_mean = costs.mean;
+    step.std_dev = costs.std_dev();
+    step.delta_mean = deltas.mean;
+    step.delta_var = deltas.var();
+    step.best_delta = best_delta;
+    step.avg_uphill = up_num ? up_sum/up_num : 0;
+    step.reject_rate = float(reject)/MT;
+    step.accept_rate = 1 - step.reject_rate;
+    mem_sample();
+    telemetry.temp_step(step, sched.T, sched.actual_T, best,
+                        fp.step_fields());
+    sched.update(step);
+
+    if(compress_schedule){
+      double f = used(moves);
+      if(f > 0)
+        sched.fit(step, step.count * (1-f) / f);
+    }
+
+    if(!telemetry.quiet)
+      printf("Iteration %d, T= %.2f -> %.2f (r= %.2f), reject= %.2f, "
+             "best= %f\n", step.count, step_T, sched.actual_T, sched.ratio,
+             step.reject_rate, best);
+
+    if((stop = sched.stop(step)))
+      break;
+
+    if(writer){
+      image.data.clear();
+      save(image, step, pre_cost, best);
+      image_sent = false;
+      if(wall_seconds() - last_write >= checkpoint_every){
+        writer->submit(image);
+        image_sent = true;
+        last_write = wall_seconds();
+      }
+    }
+  }
+  reject_num = reject;
+  telemetry.stop(sa_stop_name(stop), moves, best_move, best,
+                 wall_seconds() - wall_start);
+
+  if(writer){
+    // the step cut short is lost; keep the one before it
+    if(stop >= SA_TIME_LIMIT && !image_sent)
+      writer->submit(image);
+    delete writer;
+  }
+
+  if(stop == SA_CONVERGENT)
+    cout << "\n  Convergent!\n";
+  else if(stop == SA_COOLED)
+    cout << "\n Cooling Enough!\n";
+  else if(stop == SA_TIME_LIMIT)
+    cout << "\n Time limit reached, keeping the best so far.\n";
+  else if(stop == SA_MOVE_LIMIT)
+    cout << "\n Move limit reached, keeping the best so far.\n";
+  else if(stop == SA_INTERRUPTED)
+    cout << "\n Interrupted, keeping the best so far.\n";
+
+  printf("\n good = %d, bad=%d, rejected=%d\n", good_num, bad_num, reject_num);
+  printf(" moves = %ld, best at move %ld (%.2fs)\n\n", moves, best_move, best_wall);
+
+  sa_result.stop = stop;
+  sa_result.moves = moves;
+  sa_result.best_move = best_move;
+  sa_result.best_wall = best_wall;
+  sa_result.wall = wall_seconds() - wall_start;
+
+  fp.finish();
+  return time;
+}
+
+/* Re-run the moves of the trajectory opened for replay: every proposal
+   starts from its recorded random state and is accepted or rejected as
+   recorded. A move whose cost change differs from the recording means the
+   engine no longer computes what it did; it is counted, and the replay
+   goes on with the recorded decision.
+*/
+template<class Problem>
+double SA_Replay(Problem &fp)
+{
+  double time=seconds();
+  double wall=wall_seconds();
+  double pre_cost, best, cost;
+  long moves=0, diverged=0, best_move=0;
+  MoveRecord r;
+
+  pre_cost = best = fp.start();
+  if(pre_cost != trajectory.header.start_cost)
+    printf("replay starts from cost %f, the recording from %f\n",
+           pre_cost, trajectory.header.start_cost);
+
+  while(!sa_interrupted && trajectory.next(r)){
+    rand_set_state(r.state);
+    cost = fp.move();
+    float d_cost = cost - pre_cost;
+    if(d_cost != r.d_cost)
+      diverged++;
+    moves++;
+
+    if(r.accept){
+      fp.accept();
+      pre_cost = cost;
+      if(cost < best){
+        fp.keep_best();
+        best = cost;
+        time = seconds();
+        best_move = moves;
+      }
+    }
+    else
+      fp.reject();
+  }
+  wall = wall_seconds() - wall;
+
+  printf("\n replayed %ld of %ld moves in %.2fs (%.0f moves/s), "
+         "%ld diverged\n", moves, long(trajectory.header.moves), wall,
+         wall > 0 ? moves / wall : 0.0, diverged);
+  printf(" best %f at move %ld\n\n", best, best_move);
+
+  sa_result.stop = sa_interrupted ? SA_INTERRUPTED : SA_MOVE_LIMIT;
+  sa_result.moves = moves;
+  sa_result.best_move = best_move;
+  sa_result.best_wall = 0;
+  sa_result.wall = wall;
+
+  fp.finish();
+  return time;
+}
+
+/* Run the annealer with the schedule picked by sa_schedule, or replay
+   the trajectory opened for replay.
+   local, term_T and conv_rate are read as in ClassicSchedule.
+*/
+template<class Problem>
+double SA_Run(Problem &fp, int k, int local, float term_T, float conv_rate)
+{
+  if(replay_file[0]){
+    printf("Replaying %s\n", replay_file);
+    return SA_Replay(fp);
+  }
+  printf("Cooling schedule: %s\n", schedule_name(sa_schedule));
+  switch(sa_schedule){
+    case SCHED_FAST:{
+      FastSchedule s(local, term_T, conv_rate);
+      return Annealer<Problem,FastSchedule>(fp, s).run(k);
+    }
+    case SCHED_LAM:{
+      LamSchedule s;
+      return Annealer<Problem,LamSchedule>(fp, s).run(k);
+    }
+    case SCHED_GEOMETRIC:{
+      GeometricSchedule s(local, term_T, conv_rate);
+      return Annealer<Problem,GeometricSchedule>(fp, s).run(k);
+    }
+    default:{
+      ClassicSchedule s(local, term_T, conv_rate);
+      return Annealer<Problem,ClassicSchedule>(fp, s).run(k);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+#endif
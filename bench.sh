@@ -0,0 +1,62 @@
+#!/bin/sh
+# Benchmark: run each shipped design K times with seeds 1..K and summarize.
+#
+#   sh bench.sh [K] [outdir]
+#
+# The annealing parameters come from the design's .run file; extra btree
+# options (e.g. --max-moves=N) can be given in BENCH_ARGS and the designs
+# in DESIGNS. Each run appends a JSON line to outdir/runs.jsonl; the
+# median and 90th percentile of every metric per design are written to
+# outdir/summary.tsv, which can be diffed between builds.
+
+K=${1:-5}
+OUT=${2:-bench_out}
+DESIGNS=${DESIGNS:-"ami33 ami49 apte hp xerox"}
+METRICS="moves_per_sec time_to_best cost area wire dead violation satisfied overlaps peak_rss_kb"
+
+BTREE=`pwd`/btree
+mkdir -p $OUT || exit 1
+rm -f $OUT/runs.jsonl $OUT/*.res
+
+for d in $DESIGNS; do
+  # btree writes its outputs next to the design and appends to the .res
+  # file it is given, so run on a copy and keep both under outdir
+  cp $d $OUT/ || exit 1
+  [ -f ${d}_constraint ] && cp ${d}_constraint $OUT/
+  set -- `cat $d.run`           # btree <design> <times> <local> <avg_ratio>
+  seed=1
+  while [ $seed -le $K ]; do
+    echo "bench: $d seed $seed"
+    (cd $OUT && $BTREE $d $3 $4 $5 1 1.3 0.1 $d.res --seed=$seed --quiet \
+        --report=runs.jsonl $BENCH_ARGS > $d.$seed.log 2>&1)
+    seed=`expr $seed + 1`
+  done
+done
+
+# one "design metric value" line per sample, sorted by value
+awk -v metrics="$METRICS" '
+  {
+    gsub(/[{}"]/, "")
+    n = split($0, field, ",")
+    for(i = 1; i <= n; i++){
+      split(field[i], kv, ":")
+      v[kv[1]] = kv[2]
+    }
+    m = split(metrics, name, " ")
+    for(i = 1; i <= m; i++)
+      print v["design"], name[i], v[name[i]]
+  }' $OUT/runs.jsonl | sort -k1,1 -k2,2 -k3,3g |
+awk '
+  function flush(){
+    if(n == 0) return
+    med = n % 2 ? x[(n+1)/2] : (x[n/2] + x[n/2+1]) / 2
+    p = int(0.9 * n); if(p < 0.9 * n) p++
+    printf "%s\t%s\t%d\t%.6g\t%.6g\n", key1, key2, n, med, x[p]
+    n = 0
+  }
+  BEGIN { print "design\tmetric\tn\tmedian\tp90" }
+  $1 != key1 || $2 != key2 { flush(); key1 = $1; key2 = $2 }
+  { x[++n] = $3 }
+  END { flush() }' > $OUT/summary.tsv
+
+cat $OUT/summary.tsv
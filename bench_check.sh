@@ -0,0 +1,76 @@
+#!/bin/sh
+# Regression gate: compare a bench summary with a stored baseline.
+#
+#   sh bench_check.sh [baseline] [summary]
+#
+# Both files are bench.sh summaries (design, metric, n, median, p90). The
+# median of every metric in the baseline may get worse by at most its
+# tolerance, relative to the baseline median, or absolute where that
+# median is 0. TOL overrides tolerances, e.g. TOL="moves_per_sec=0.05".
+# Exits 1 if a metric regressed or is missing, 2 if a file is unreadable.
+
+BASE=${1:-bench_baseline.tsv}
+NEW=${2:-bench_out/summary.tsv}
+
+for f in $BASE $NEW; do
+  if [ ! -r $f ]; then
+    echo "bench_check: cannot read $f"
+    exit 2
+  fi
+done
+
+# metric, direction (+1 higher is better), tolerance
+DEFAULTS="moves_per_sec:+1:0.10 time_to_best:-1:0.25 cost:-1:0.02
+  area:-1:0.02 wire:-1:0.02 dead:-1:0.05 violation:-1:0.01
+  satisfied:+1:0 overlaps:-1:0 peak_rss_kb:-1:0.20"
+
+awk -v defaults="$DEFAULTS" -v tol="$TOL" '
+  BEGIN {
+    n = split(defaults, d, /[ \n]+/)
+    for(i = 1; i <= n; i++){
+      if(split(d[i], f, ":") != 3) continue
+      dir[f[1]] = f[2] + 0
+      limit[f[1]] = f[3] + 0
+    }
+    n = split(tol, d, /[ ,]+/)
+    for(i = 1; i <= n; i++)
+      if(split(d[i], f, "=") == 2)
+        limit[f[1]] = f[2] + 0
+    printf "%-8s %-14s %12s %12s %9s  %s\n",
+           "design", "metric", "baseline", "new", "change", "status"
+  }
+  FNR == 1 { next }                     # header line
+  FILENAME == ARGV[1] { base[$1 "\t" $2] = $4; order[++keys] = $1 "\t" $2; next }
+  { now[$1 "\t" $2] = $4 }
+  END {
+    bad = 0
+    for(k = 1; k <= keys; k++){
+      key = order[k]
+      split(key, f, "\t")
+      m = f[2]
+      if(!(m in dir)){
+        status = "skipped"
+      }
+      else if(!(key in now)){
+        status = "MISSING"; bad++
+      }
+      else{
+        b = base[key]; v = now[key]
+        # worse: how far the median moved against the metric, relative
+        worse = (b - v) * dir[m]
+        if(b != 0) worse /= (b < 0 ? -b : b)
+        status = worse > limit[m] + 1e-12 ? "REGRESSED" : "ok"
+        if(status != "ok") bad++
+      }
+      change = ""
+      if(key in now && base[key] != 0)
+        change = sprintf("%+.1f%%", (now[key] - base[key]) / base[key] * 100)
+      printf "%-8s %-14s %12s %12s %9s  %s\n", f[1], m, base[key],
+             (key in now) ? now[key] : "-", change, status
+    }
+    if(bad)
+      printf "bench_check: %d regression(s)\n", bad
+    else
+      print "bench_check: no regressions"
+    exit bad ? 1 : 0
+  }' $BASE $NEW
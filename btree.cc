@@ -13,16 +13,39 @@
 #include <climits>
 #include <string.h>
 #include "btree.h"
+#include "checkpoint.h"
+#include "memstat.h"
 
 using namespace std;
 //---------------------------------------------------------------------------
 float rotate_rate = 0.3;
 float swap_rate = 0.5;
 
+static long tree_clock = 0;     // last B_Tree::stamp handed out
+
+// a snapshot's storage grew or shrank from "capacity" to what it is now
+static void account_snapshot(size_t capacity, const vector<Node>& nodes)
+{
+    if (nodes.capacity() == capacity)
+        return;
+    if (capacity)
+        mem_free(MEM_SNAPSHOTS, capacity * sizeof(Node));
+    if (nodes.capacity())
+        mem_alloc(MEM_SNAPSHOTS, nodes.capacity() * sizeof(Node));
+}
+
 //---------------------------------------------------------------------------
 //   Initialization
 //---------------------------------------------------------------------------
 
+B_Tree::~B_Tree() {
+    release_nodes();
+    account_snapshot(last_sol.nodes.capacity(), vector<Node>());
+    account_snapshot(best_sol.nodes.capacity(), vector<Node>());
+    if (mem_bytes)
+        mem_free(MEM_BTREES, mem_bytes);
+}
+
 void B_Tree::clear() {
     // initial contour value
     FPlan::clear();
@@ -71,7 +94,6 @@ void B_Tree::initWithOutNode()
     contour.resize(modules.size());
     modules_info.resize(modules_N);
     variants.clear();
-    variants.reserve(vector_max_size);
     TotalArea = 0;
     for (int i = 0; i < modules_N; i++) {
         TotalArea += modules[i].area;
@@ -83,6 +105,7 @@ void B_Tree::initWithOutNode()
     nodes_N = nodes.size();
 
     packing();
+    account();
 }
 
 //Initialize B*tree with node indice
@@ -95,13 +118,14 @@ void B_Tree::initWithNodeIndices(vector<int> indices)
 
     TotalArea = 0;
 
+    // a new tree replaces the old one
+    release_nodes();
     vector<Node*> nodes;
 
     // set every id of nodes
     for (int i = 0; i < indices.size(); i++)
     {
-        Node* node = (Node*) new unsigned char[sizeof(Node)];
-        memset(node, 0, sizeof(Node));
+        Node* node = new_node();
         nodes.push_back(node);
         node = nodes.back();
         node->id = indices[i];
@@ -111,7 +135,7 @@ void B_Tree::initWithNodeIndices(vector<int> indices)
             for (int t = 0; t < variants.size(); t++)
             {
                 if (variants[t].mod == indices[i]) {
-                    j = rand() % variants[t].ratios.size();
+                    j = rand_int(variants[t].ratios.size());
                     node->ratio = variants[t].ratios[j];
                 }
             }
@@ -138,6 +162,8 @@ void B_Tree::initWithNodeIndices(vector<int> indices)
     clear();
 
     normalize_cost(10);
+    account();
+    touch();
 }
 
 //---------------------------------------------------------------------------
@@ -147,6 +173,8 @@ void B_Tree::initWithNodeIndices(vector<int> indices)
 void B_Tree::packing() {
     stack<Node*> S;
 
+    pin_chains();
+    gather_group();
     clear();
     Node* p = nodes_root;
     place_module(p, nullptr);
@@ -402,8 +430,10 @@ Node* B_Tree::child(Node* node, DIR d) {
 //---------------------------------------------------------------------------
 
 void B_Tree::get_solution(Solution& sol) {
-    sol.nodes = vector<Node>();
+    // the copy reuses the snapshot's storage
+    size_t capacity = sol.nodes.capacity();
     copyTree(sol.nodes);
+    account_snapshot(capacity, sol.nodes);
     sol.nodes_root = &sol.nodes[0];
     sol.cost = getCost();
 }
@@ -426,13 +456,43 @@ void B_Tree::recover_best() {
 
 void B_Tree::recover(Solution& sol) {
     nodes_root = sol.nodes_root;
-    if (prev_tree)
-        prev_tree->clear();
     vector<Node>* tree = new vector<Node>();
 
     copyTree(*tree);
-    prev_tree = tree;
-    nodes_root = &(tree->at(0));
+    adoptTree(tree);
+}
+
+void B_Tree::save_state(Blob& b) {
+    vector<Node> tree;
+    copyTree(tree);
+    b.put_tree(tree);
+    b.put(last_sol.cost);
+    b.put_tree(last_sol.nodes);
+    b.put(best_sol.cost);
+    b.put_tree(best_sol.nodes);
+}
+
+bool B_Tree::load_state(Blob& b) {
+    Solution cur;
+    size_t last_capacity = last_sol.nodes.capacity();
+    size_t best_capacity = best_sol.nodes.capacity();
+    bool ok = b.get_tree(cur.nodes) && b.get(last_sol.cost) &&
+              b.get_tree(last_sol.nodes) && b.get(best_sol.cost) &&
+              b.get_tree(best_sol.nodes);
+    account_snapshot(last_capacity, last_sol.nodes);
+    account_snapshot(best_capacity, best_sol.nodes);
+    if (!ok)
+        return false;
+    if (cur.nodes.size() != modules_N || last_sol.nodes.size() != modules_N ||
+        best_sol.nodes.size() != modules_N)
+        return false;
+
+    cur.nodes_root = &cur.nodes[0];
+    last_sol.nodes_root = &last_sol.nodes[0];
+    best_sol.nodes_root = &best_sol.nodes[0];
+    recover(cur);
+    packing();
+    return true;
 }
 
 
@@ -444,9 +504,10 @@ void B_Tree::perturb() {
     auto nodes = allnodes();
     if (nodes.size() < 4)
         return;
+    touch();
 
     int p, n;
-    n = rand() % nodes.size();  //modules_N;
+    n = rand_int(nodes.size());  //modules_N;
 
   //  changed_nodes.clear();
   //  changed_root = NIL;
@@ -461,7 +522,7 @@ void B_Tree::perturb() {
 
         if (swap_rate > rand_01()) {
             do {
-                p = rand() % nodes.size(); //modules_N;
+                p = rand_int(nodes.size()); //modules_N;
             } while (n == p || nodes[n]->parent == nodes[p] || nodes[p]->parent == nodes[n]);
 
             //      changed_nodes.push_back(nodes[p]);
@@ -472,7 +533,7 @@ void B_Tree::perturb() {
         }
         else {
             do {
-                p = rand() % nodes.size(); //modules_N;
+                p = rand_int(nodes.size()); //modules_N;
             } while (n == p);
 
             //      changed_nodes.push_back(nodes[p]);
@@ -549,7 +610,7 @@ Node* B_Tree::find_node_random()
     auto nodes = allnodes();
     if (nodes.empty() || nodes.size() == 0)
         return nullptr;
-    int i = rand() % nodes.size();
+    int i = rand_int(nodes.size());
     return nodes[i];
 }
 
@@ -570,15 +631,14 @@ void B_Tree::insertNodeById(Node* parent, int moduleId)
         if (nodes[i]->id == moduleId)
             return;
     // [2]. make new node.
-    Node* node = (Node*) new unsigned char[sizeof(Node)];
-    memset(node, 0, sizeof(Node));
+    Node* node = new_node();
     node->id = moduleId;
     // insert variant constraint info to the node.
     if (!variants.empty()) {
         for (int t = 0; t < variants.size(); t++)
         {
             if (variants[t].mod == moduleId) {
-                j = rand() % variants[t].ratios.size();
+                j = rand_int(variants[t].ratios.size());
                 node->ratio = variants[t].ratios[j];
                 break;
             }
@@ -587,6 +647,7 @@ void B_Tree::insertNodeById(Node* parent, int moduleId)
     // [3]. insert new node.
     insert_node(parent, node);
     nodes_N = allnodes().size();
+    touch();
 }
 
 // To swap two nodes with given ids
@@ -614,7 +675,7 @@ void B_Tree::swap_node_by_id(int m1, int m2)
     else {
         swap_node(n1, n2);
     }
-
+    touch();
 }
 // To insert node
 void B_Tree::insert_node(Node* parent, Node* node) {
@@ -651,22 +712,24 @@ void B_Tree::delete_node_by_id(int moduleID)
         {
             auto node = nodes[i];
             delete_node(nodes[i]);
-            SAFE_DELETE(node);
+            free_node(node);
 
             break;
         }
     nodes_N = allnodes().size();
+    touch();
 }
 
 int B_Tree::take_node_random()
 {
     auto nodes = allnodes();
-    int i = rand() % nodes.size();
+    int i = rand_int(nodes.size());
     int ModuleId = nodes[i]->id;
     auto node = nodes[i];
     delete_node(nodes[i]);
-    SAFE_DELETE(node);
+    free_node(node);
     nodes_N = allnodes().size();
+    touch();
     return ModuleId;
 }
 
@@ -678,8 +741,9 @@ bool B_Tree::take_node(int mod_id)
         if (nodes[i]->id == mod_id) {
             auto node = nodes[i];
             delete_node(nodes[i]);
-            SAFE_DELETE(node);
+            free_node(node);
             nodes_N = allnodes().size();
+            touch();
             return true;
         }
     }
@@ -796,6 +860,161 @@ bool B_Tree::delete_node2(Node* node, DIR pull) {
         return false;
 }
 
+/*
+   The root's left chain packs along the bottom edge and its right chain
+   along the left one. Minimum separation shifts some of them off: the
+   separated module itself, its left child, and on the right chain every
+   node above it. Move each pinned module that is not against an edge
+   onto the shorter chain where it will be: below the last left chain
+   node not separated, or to the end of a right chain with none. When
+   even the root is separated, with no such node, the module takes the
+   root's place and its right chain. Deterministic, so packing the same
+   tree twice gives the same result.
+*/
+
+void B_Tree::pin_chains() {
+    if (pinned.empty() || nodes_root == nullptr)
+        return;
+
+    vector<char> pin(modules.size(), 0), sep(modules.size(), 0);
+    for (int i = 0; i < min_seps.size(); i++)
+        if (min_seps[i].mod != NIL)
+            sep[min_seps[i].mod] = 1;
+    for (int i = 0; i < pinned.size(); i++)
+        pin[pinned[i]] = !sep[pinned[i]];
+
+    auto on_edge = [&](Node* n) {
+        if (sep[n->id])
+            return false;
+        Node* c = n;
+        while (c->parent != nullptr && c->parent->left == c)
+            c = c->parent;
+        if (c->parent == nullptr && (n->parent == nullptr || !sep[n->parent->id]))
+            return true;        // bottom
+        for (c = n; c->parent != nullptr; c = c->parent)
+            if (c->parent->right != c || sep[c->parent->id])
+                return false;
+        return true;            // left
+    };
+
+    // all of them off first: taking one out can pull others off an edge,
+    // but only from its own subtree, later in preorder
+    vector<Node*> off;
+    auto nodes = allnodes();
+    for (int i = 0; i < nodes.size(); i++) {
+        Node* n = nodes[i];
+        if (!pin[n->id] || on_edge(n))
+            continue;
+        // off the edges, so not the root
+        delete_node2(n, LEFT);
+        n->left = n->right = nullptr;
+        off.push_back(n);
+    }
+
+    // putting one back keeps the others where they were, or on an edge
+    for (int i = 0; i < off.size(); i++) {
+        Node* n = off[i];
+        Node* ends[2] = { nodes_root, nodes_root };
+        int length[2] = { 0, 0 };
+        for (int d = LEFT; d <= RIGHT; d++)
+            for (; child(ends[d], d) != nullptr; length[d]++)
+                ends[d] = child(ends[d], d);
+        Node* last = nullptr;
+        for (Node* c = nodes_root; c != nullptr; c = c->left)
+            if (!sep[c->id])
+                last = c;
+        bool clear = true;
+        for (Node* c = nodes_root; c != nullptr; c = c->right)
+            clear &= !sep[c->id];
+        if (clear && length[RIGHT] < length[LEFT])
+            wire_nodes(ends[RIGHT], n, RIGHT);
+        else if (last != nullptr) {
+            wire_nodes(n, last->left, LEFT);
+            wire_nodes(last, n, LEFT);
+        }
+        else {
+            Node* r = nodes_root;
+            wire_nodes(n, r->right, RIGHT);
+            r->right = nullptr;
+            wire_nodes(n, r, LEFT);
+            nodes_root = n;
+            n->parent = nullptr;
+        }
+    }
+    if (!off.empty())
+        touch();
+}
+
+/*
+   Keep the group's modules as one subtree holding nothing else, rooted at
+   the first of them in preorder. Others hung under the group move up
+   above that root; members outside it move to its shallowest free slot.
+   Deterministic, like pin_chains.
+*/
+
+void B_Tree::gather_group() {
+    if (group.size() < 2 || nodes_root == nullptr)
+        return;
+
+    vector<char> in(modules.size(), 0);
+    for (int i = 0; i < group.size(); i++)
+        in[group[i]] = 1;
+    auto nodes = allnodes();
+    Node* top = nullptr;
+    for (int i = 0; i < nodes.size() && top == nullptr; i++)
+        if (in[nodes[i]->id])
+            top = nodes[i];
+    if (top == nullptr)
+        return;
+
+    // the group's subtree down to the first module not in it on each path
+    bool moved = false;
+    vector<char> held(modules.size(), 0);
+    vector<Node*> queue(1, top);
+    held[top->id] = 1;
+    for (int q = 0; q < queue.size(); q++) {
+        Node* n = queue[q];
+        for (int d = LEFT; d <= RIGHT; d++) {
+            Node* c;
+            while ((c = child(n, d)) != nullptr && !in[c->id]) {
+                // its children take its place under n
+                delete_node2(c, LEFT);
+                c->left = c->right = nullptr;
+                if (top->parent == nullptr) {
+                    nodes_root = c;
+                    c->parent = nullptr;
+                }
+                else
+                    wire_nodes(top->parent, c, top->parent->left == top ? LEFT : RIGHT);
+                wire_nodes(c, top, LEFT);
+                moved = true;
+            }
+            if (c != nullptr) {
+                held[c->id] = 1;
+                queue.push_back(c);
+            }
+        }
+    }
+
+    // the rest, never the root since top comes first, as leaves of it
+    int slot = 0;
+    for (int i = 0; i < nodes.size(); i++) {
+        Node* m = nodes[i];
+        if (!in[m->id] || held[m->id])
+            continue;
+        delete_node2(m, LEFT);
+        m->left = m->right = nullptr;
+        while (queue[slot]->left != nullptr && queue[slot]->right != nullptr)
+            slot++;
+        wire_nodes(queue[slot], m, queue[slot]->left == nullptr ? LEFT : RIGHT);
+        held[m->id] = 1;
+        queue.push_back(m);
+        moved = true;
+    }
+    if (moved)
+        touch();
+}
+
 /*
    Insert node into parent's left or right subtree according by "edge".
    Push node into parent's subtree in  "push" direction.
@@ -853,8 +1072,9 @@ void _copyTree(Node* parent, Node* node, bool is_left, vector<Node>& tree)
 }
 void B_Tree::copyTree(vector<Node>& tree)
 {
-    tree.reserve(vector_max_size);
+    // _copyTree links the copies by address, so the vector must not grow
     tree.clear();
+    tree.reserve(getNodesCount());
     _copyTree(nullptr, nodes_root, true, tree);
 }
 
@@ -878,11 +1098,82 @@ vector<Node*> B_Tree::allnodes()
 
 // To delete all nodes from a B* tree
 void B_Tree::destroy() {
-    auto nodes = allnodes();
-    for (int i = 0; i < nodes.size(); i++)
-    {
-        SAFE_DELETE(nodes[i]);
+    release_nodes();
+    nodes_root = nullptr;
+    nodes_N = 0;
+}
+
+//---------------------------------------------------------------------------
+//   Node Storage
+//---------------------------------------------------------------------------
+
+Node* B_Tree::new_node() {
+    Node* node = new Node();
+    node->heap = heap_nodes.size();
+    heap_nodes.push_back(node);
+    mem_alloc(MEM_NODES, sizeof(Node));
+    return node;
+}
+
+// Nodes that live in the recovered vector stay there until the next recover;
+// copies of a heap node into it keep the index, so it is checked.
+void B_Tree::free_node(Node* node) {
+    int i = node->heap;
+    if (i < 0 || i >= heap_nodes.size() || heap_nodes[i] != node)
+        return;
+    heap_nodes[i] = heap_nodes.back();
+    heap_nodes[i]->heap = i;
+    heap_nodes.pop_back();
+    delete node;
+    mem_free(MEM_NODES, sizeof(Node));
+}
+
+void B_Tree::release_nodes() {
+    for (int i = 0; i < heap_nodes.size(); i++) {
+        delete heap_nodes[i];
+        mem_free(MEM_NODES, sizeof(Node));
+    }
+    heap_nodes.clear();
+    if (prev_tree) {
+        mem_free(MEM_NODES, prev_tree->capacity() * sizeof(Node));
+        delete prev_tree;
+        prev_tree = nullptr;
     }
-    nodes.clear();
 }
 
+// The tree's old nodes are freed; "tree" must be linked within itself.
+void B_Tree::adoptTree(vector<Node>* tree) {
+    release_nodes();
+    prev_tree = tree;
+    mem_alloc(MEM_NODES, tree->capacity() * sizeof(Node));
+    nodes_root = tree->empty() ? nullptr : &tree->at(0);
+    touch();
+}
+
+// Bytes held by this tree's copy of the design, kept in MEM_BTREES.
+void B_Tree::account() {
+    long bytes = sizeof(B_Tree) + modules.capacity() * sizeof(Module) +
+                 modules_info.capacity() * sizeof(Module_Info) +
+                 network.capacity() * sizeof(Net) +
+                 contour.capacity() * sizeof(Contour) +
+                 variants.capacity() * sizeof(VARIANT);
+    for (int i = 0; i < modules.size(); i++)
+        bytes += modules[i].pins.capacity() * sizeof(Pin);
+    for (int i = 0; i < network.size(); i++)
+        bytes += network[i].capacity() * sizeof(Pin_p);
+
+    if (bytes == mem_bytes)
+        return;
+    if (mem_bytes)
+        mem_free(MEM_BTREES, mem_bytes);
+    mem_alloc(MEM_BTREES, bytes);
+    mem_bytes = bytes;
+}
+
+void B_Tree::touch() {
+    stamp = ++tree_clock;
+}
+
+long B_Tree::last_stamp() {
+    return tree_clock;
+}
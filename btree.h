@@ -24,6 +24,8 @@
 }
 
 //---------------------------------------------------------------------------
+class Blob;
+
 const int NIL = -1;
 typedef bool DIR;
 const bool LEFT=0, RIGHT=1;
@@ -57,7 +59,8 @@ struct Contour{
 
 class B_Tree : public FPlan{
   public:
-    B_Tree(float calpha=1) :FPlan(calpha) { prev_tree = nullptr; }
+    B_Tree(float calpha=1) :FPlan(calpha) { prev_tree = nullptr; mem_bytes = 0; touch(); }
+    ~B_Tree();
     virtual void init();
     virtual void packing();
     virtual void perturb();
@@ -80,14 +83,28 @@ class B_Tree : public FPlan{
     void show_tree();  
     int getNodesCount();
     void copyTree(vector<Node> &tree);
+    void adoptTree(vector<Node> *tree);   // takes over a linked copy
     vector<Node*> allnodes();
     void destroy();
 
+    // stamp of the tree's contents: every edit gives it a new value, so two
+    // equal stamps mean the same tree and the same packing
+    long stamp;
+    void touch();
+    // last stamp handed out to any tree: it moves on with every edit
+    static long last_stamp();
+
+    // checkpoint of the current, last and best trees
+    void save_state(Blob &b);
+    bool load_state(Blob &b);
+
     int contour_root;
     vector<Contour> contour;
     vector<VARIANT> variants;
     vector<MINIMUM_SEPERATION> min_seps;
     vector<FIXED_BOUNDARY>  fixed_bndries;
+    vector<int> pinned;         // modules kept on the root's left or right chain
+    vector<int> group;          // modules kept as a subtree of their own
 
     // vector<Node> nodes;   
 
@@ -111,9 +128,18 @@ class B_Tree : public FPlan{
     
     bool delete_node2(Node *node,DIR pull);
 	  void insert_node2(Node *parent,Node *node,DIR edge=LEFT,DIR push=LEFT,bool fold=false);
+    void pin_chains();
+    void gather_group();
 
     void calcTotalArea();
 
+    // node storage: nodes made one at a time, plus the vector the tree
+    // was last recovered into; both are freed with the tree
+    Node* new_node();
+    void free_node(Node *node);
+    void release_nodes();
+    void account();
+
   private:        
     struct Solution{
       Node* nodes_root;
@@ -131,6 +157,8 @@ class B_Tree : public FPlan{
     vector<Node> changed_nodes;
     Node* changed_root;    
     vector<Node>* prev_tree;
+    vector<Node*> heap_nodes;
+    long mem_bytes;     // accounted to MEM_BTREES
     Node* prev_node;
 };
 
@@ -11,44 +11,245 @@
 #include <cstring>
 #include "btree.h"
 #include "qbtree.h"
+#include "feasibility.h"
 #include "sa.h"
+#include "annealer.h"
+#include "checkpoint.h"
+#include "telemetry.h"
+#include "profile.h"
+#include "memstat.h"
+#include "trajectory.h"
+#include <csignal>
 //---------------------------------------------------------------------------
 
+static uint64_t seed = time(0);
+static char report_file[256] = "";
+
+// stop the anneal cleanly; the best solution so far is still written out
+static void on_signal(int)
+{
+   sa_interrupted = 1;
+}
+
+// the file named after the "=" of "option", in full; false without one
+static bool file_option(char *file, int size, const char *option)
+{
+   const char *value = strchr(option,'=');
+   if(value == NULL || !value[1])
+     return false;
+   strncpy(file, value+1, size-1);
+   file[size-1] = 0;
+   return true;
+}
+
+// "--name=value" options, accepted anywhere on the command line
+static bool parse_option(const char *option)
+{
+   char arg[80], *value;
+   strncpy(arg, option, sizeof(arg)-1);
+   arg[sizeof(arg)-1] = 0;
+   value = strchr(arg,'=');
+   if(value) *value++ = 0;
+   else value = (char*)"";
+
+   if(!strcmp(arg,"--schedule")){
+     sa_schedule = schedule_by_name(value);
+     return sa_schedule >= 0;
+   }
+   else if(!strcmp(arg,"--cool"))      geo_alpha = atof(value);
+   else if(!strcmp(arg,"--fsa-c"))     fsa_c = atoi(value);
+   else if(!strcmp(arg,"--lam-steps")) lam_steps = atoi(value);
+   else if(!strcmp(arg,"--time-limit"))time_limit = atof(value);
+   else if(!strcmp(arg,"--max-moves")) max_moves = atol(value);
+   else if(!strcmp(arg,"--compress"))  compress_schedule = true;
+   else if(!strcmp(arg,"--seed"))      seed = strtoull(value,NULL,10);
+   else if(!strcmp(arg,"--report"))
+     return file_option(report_file, sizeof(report_file), option);
+   else if(!strcmp(arg,"--checkpoint"))
+     return file_option(checkpoint_file, sizeof(checkpoint_file), option);
+   else if(!strcmp(arg,"--checkpoint-every"))
+     checkpoint_every = atof(value);
+   else if(!strcmp(arg,"--resume"))
+     return file_option(resume_file, sizeof(resume_file), option);
+   else if(!strcmp(arg,"--telemetry"))
+     return file_option(telemetry_file, sizeof(telemetry_file), option);
+   else if(!strcmp(arg,"--telemetry-rate"))
+     telemetry.interval = atof(value);
+   else if(!strcmp(arg,"--quiet"))     telemetry.quiet = true;
+   else if(!strcmp(arg,"--profile"))
+     return file_option(profile_file, sizeof(profile_file), option);
+   else if(!strcmp(arg,"--perf-counters")) profile_counters = true;
+   else if(!strcmp(arg,"--full-check"))  full_check = true;
+   else if(!strcmp(arg,"--repair-retries")) repair_retries = atoi(value);
+   else if(!strcmp(arg,"--pin-boundary"))  pin_boundary = true;
+   else if(!strcmp(arg,"--cluster-proximity")) cluster_proximity = true;
+   else if(!strcmp(arg,"--infeasible")){
+     feasibility_mode = feasibility_by_name(value);
+     return feasibility_mode >= 0;
+   }
+   else if(!strcmp(arg,"--record"))
+     return file_option(record_file, sizeof(record_file), option);
+   else if(!strcmp(arg,"--replay"))
+     return file_option(replay_file, sizeof(replay_file), option);
+   else return false;
+   return true;
+}
+
+static void usage(int times, int local, float alpha, float term_temp)
+{
+   printf("Usage: btree <filename> [times=%d] [hill_climb_stage=%d]\n",
+         times, local);
+   printf("        [avg_ratio=%.1f] [cost_ratio=%f]\n",avg_ratio,alpha);
+   printf("        [lamda=%.2f] [term-temp=%.2f]\n",lamda,term_temp);
+   printf("        [output]\n");
+   printf("Options:\n");
+   printf("  --schedule=classic|fast|lam|geometric  cooling schedule (%s)\n",
+          schedule_name(sa_schedule));
+   printf("  --cool=F        geometric cooling factor (%.2f)\n",geo_alpha);
+   printf("  --fsa-c=N       Fast-SA pseudo-greedy scale (%d)\n",fsa_c);
+   printf("  --lam-steps=N   temperature steps planned by lam (%d)\n",lam_steps);
+   printf("  --time-limit=S  stop annealing after S wall-clock seconds\n");
+   printf("  --max-moves=N   stop annealing after N moves\n");
+   printf("  --compress      cool faster so the schedule fits the budget\n");
+   printf("  --seed=N        seed of the random number generator (time)\n");
+   printf("  --checkpoint=FILE    save the anneal state to FILE\n");
+   printf("  --checkpoint-every=S seconds between checkpoints (%.0f)\n",
+          checkpoint_every);
+   printf("  --resume=FILE   continue the anneal saved in FILE\n");
+   printf("  --telemetry=FILE     JSON-lines statistics of the run (- = stdout)\n");
+   printf("  --telemetry-rate=S   at most one temp/best event per S seconds\n");
+   printf("  --quiet         no progress output during the anneal\n");
+   printf("  --report=FILE   append a JSON line with the run's results\n");
+   printf("  --profile=FILE  per-phase timings as JSON (make PROFILE=1)\n");
+   printf("  --perf-counters hardware counters per phase (make PROFILE=1)\n");
+   printf("  --record=FILE   log every proposed move to FILE\n");
+   printf("  --replay=FILE   re-run the moves logged in FILE, no annealing\n");
+   printf("  --full-check    check every constraint on every move\n");
+   printf("  --repair-retries=N   perturbations per move, 0 = no limit (%d)\n",
+          repair_retries);
+   printf("  --pin-boundary  keep boundary modules on an edge of their B*-tree\n");
+   printf("  --cluster-proximity  keep the proximity group as one B*-subtree\n");
+   printf("  --infeasible=warn|abort|relax  constraints that can never be met (warn)\n");
+}
+
+// one JSON line per run, read by bench.sh
+static void write_report(QBtree &qbt, const char *design, int overlaps)
+{
+   FILE *fs = fopen(report_file,"a");
+   if(fs == NULL){
+     printf("unable to open report file: %s\n", report_file);
+     return;
+   }
+   double violation = qbt.calcViolationCost();
+   fprintf(fs,"{\"design\":\"%s\",\"seed\":%llu,\"schedule\":\"%s\","
+              "\"stop\":\"%s\",\"moves\":%ld,\"wall\":%.3f,"
+              "\"moves_per_sec\":%.1f,\"time_to_best\":%.3f,"
+              "\"cost\":%.6f,\"area\":%.0f,\"wire\":%.0f,\"dead\":%.6f,"
+              "\"violation\":%.6f,\"satisfied\":%d,\"overlaps\":%d,"
+              "\"peak_rss_kb\":%ld,\"perturbations\":%ld,\"fallbacks\":%ld",
+           design, (unsigned long long)seed, schedule_name(sa_schedule),
+           sa_stop_name(sa_result.stop), sa_result.moves, sa_result.wall,
+           sa_result.wall > 0 ? sa_result.moves / sa_result.wall : 0.0,
+           sa_result.best_wall, qbt.cost, qbt.Area, qbt.WireLength,
+           qbt.Area > 0 ? (qbt.Area - qbt.TotalArea) / qbt.Area : 0.0,
+           violation, violation == 0, overlaps, mem_peak_rss_kb(),
+           qbt.perturbations, qbt.fallbacks);
+   // the checks of each kind of constraint over the run, as flat keys
+   // named after the kind: bench.sh reads the line without nesting
+   for(int k=0; k < CONS_KINDS; k++){
+     if(qbt.count_constraints(k) == 0)
+       continue;
+     const char *n = cons_kind_names[k];
+     RepairStats &r = qbt.repair_stats[k];
+     fprintf(fs,",\"%s_checks\":%ld,\"%s_skipped\":%ld,\"%s_violated\":%ld,"
+                "\"%s_repairs\":%ld,\"%s_failures\":%ld,\"%s_seconds\":%.3f,"
+                "\"%s_violation\":%.6f",
+             n, r.checks, n, r.skipped, n, r.violations, n, r.repairs,
+             n, r.failures, n, r.seconds, n, qbt.violation_parts[k]);
+   }
+   fprintf(fs,"}\n");
+   fclose(fs);
+}
+
 int main(int argc,char **argv)
 {
    char filename[80],outfile[80]="",outresult[80]="";
    int times=30, local=7;
    float init_temp=0.9, term_temp=0.1;
    float alpha=1;
-   srand(time(0));
-  
-   if(argc<=1){
-     printf("Usage: btree <filename> [times=%d] [hill_climb_stage=%d]\n",
-           times, local);
-     printf("        [avg_ratio=%.1f] [cost_ratio=%f]\n",avg_ratio,alpha);
-     printf("        [lamda=%.2f] [term-temp=%.2f]\n",lamda,term_temp);
-     printf("        [output]\n");
+   signal(SIGINT, on_signal);
+   signal(SIGTERM, on_signal);
+
+   char *args[16];
+   int argn=0;
+   for(int i=1; i < argc; i++){
+     if(!strncmp(argv[i],"--",2)){
+       if(!parse_option(argv[i])){
+         printf("unknown option: %s\n", argv[i]);
+         usage(times, local, alpha, term_temp);
+         return 0;
+       }
+     }
+     else if(argn < 16)
+       args[argn++] = argv[i];
+   }
+
+   if(argn<1){
+     usage(times, local, alpha, term_temp);
      return 0;
    }else{
-     int argi=1;
-     if(argi < argc) strcpy(filename, argv[argi++]);
-     if(argi < argc) times=atoi(argv[argi++]);
-     if(argi < argc) local=atoi(argv[argi++]);
-     if(argi < argc) avg_ratio=atof(argv[argi++]);
-     if(argi < argc) alpha=atof(argv[argi++]);
-     if(argi < argc) lamda=atof(argv[argi++]);
-     if(argi < argc) term_temp=atof(argv[argi++]);
-     if(argi < argc) strcpy(outfile, argv[argi++]);
+     int argi=0;
+     if(argi < argn) strcpy(filename, args[argi++]);
+     if(argi < argn) times=atoi(args[argi++]);
+     if(argi < argn) local=atoi(args[argi++]);
+     if(argi < argn) avg_ratio=atof(args[argi++]);
+     if(argi < argn) alpha=atof(args[argi++]);
+     if(argi < argn) lamda=atof(args[argi++]);
+     if(argi < argn) term_temp=atof(args[argi++]);
+     if(argi < argn) strcpy(outfile, args[argi++]);
+   }
+
+   if(record_file[0] && (replay_file[0] || resume_file[0])){
+     printf("--record needs a new anneal, not --replay or --resume\n");
+     return 0;
+   }
+   if(replay_file[0]){
+     if(!trajectory.open(replay_file)){
+       printf("unable to read move log: %s\n", replay_file);
+       return 0;
+     }
+     seed = trajectory.header.seed;
+     if(strcmp(trajectory.header.design, filename))
+       printf("move log was recorded on %s\n", trajectory.header.design);
+   }
+   if(record_file[0] && !trajectory.create(record_file, filename, seed)){
+     printf("unable to open move log: %s\n", record_file);
+     return 0;
+   }
+
+   rand_seed(seed);
+   profile_start();
+
+   if(telemetry_file[0] && !telemetry.open(telemetry_file)){
+     printf("unable to open telemetry file: %s\n", telemetry_file);
+     return 0;
    }
 
    try{
     QBtree qbt;
     double time = seconds();
+    double wall = wall_seconds();
     qbt.init(alpha,filename,times,local,term_temp);
     
     double last_time = qbt.SA_Floorplan(times, local, term_temp);
+    trajectory.close();
     //qbt.show_module();
     qbt.getCost();
+    printf("Cost= %f, Area= %.6f, Wire= %.3f\n", qbt.cost, qbt.Area*1e-6,
+           qbt.WireLength*1e-3);
+    int overlaps = qbt.verify_placement(10);
+    if(overlaps == 0)
+      printf("placement: legal\n");
     { // log performance and quality
        if(strlen(outfile)==0){
         strcpy(outfile,filename);
@@ -57,7 +258,11 @@ int main(int argc,char **argv)
 
        last_time = last_time - time;
        printf("CPU time       = %.2f\n",seconds()-time);
+       printf("Wall time      = %.2f\n",wall_seconds()-wall);
        printf("Last CPU time  = %.2f\n",last_time);
+       profile_report();
+       memory_report();
+       qbt.repair_report();
 
        // Appending .res file
        FILE *fs= fopen(outfile,"a+");
@@ -101,6 +306,9 @@ int main(int argc,char **argv)
        fprintf(fs,"\n");
        fclose(fs);
 
+       if(report_file[0])
+         write_report(qbt, filename, overlaps);
+
        //Creating matlab plot
       strcpy(outresult,filename);
       strcat(outresult,"_output.m");
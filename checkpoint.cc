@@ -0,0 +1,143 @@
+//---------------------------------------------------------------------------
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "checkpoint.h"
+#include "btree.h"
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+//---------------------------------------------------------------------------
+char   checkpoint_file[256] = "";
+double checkpoint_every = 60;
+char   resume_file[256] = "";
+
+//---------------------------------------------------------------------------
+//   Blob
+//---------------------------------------------------------------------------
+
+static int node_index(const vector<Node> &tree, const Node *p){
+  return p == nullptr ? NIL : int(p - &tree[0]);
+}
+
+void Blob::put_tree(const vector<Node> &tree){
+  put(int(tree.size()));
+  for(int i=0; i < tree.size(); i++){
+    const Node &n = tree[i];
+    put(n.id);
+    put(n.rotate);
+    put(n.flip);
+    put(n.ratio);
+    put(node_index(tree, n.parent));
+    put(node_index(tree, n.left));
+    put(node_index(tree, n.right));
+  }
+}
+
+bool Blob::get_tree(vector<Node> &tree){
+  int size;
+  if(!get(size) || size < 0)
+    return false;
+
+  tree.resize(size);
+  for(int i=0; i < size; i++){
+    Node &n = tree[i];
+    int link[3];
+    if(!get(n.id) || !get(n.rotate) || !get(n.flip) || !get(n.ratio) ||
+       !get(link[0]) || !get(link[1]) || !get(link[2]))
+      return false;
+    for(int j=0; j < 3; j++)
+      if(link[j] < NIL || link[j] >= size)
+        return false;
+    n.parent = link[0] == NIL ? nullptr : &tree[link[0]];
+    n.left   = link[1] == NIL ? nullptr : &tree[link[1]];
+    n.right  = link[2] == NIL ? nullptr : &tree[link[2]];
+  }
+  return true;
+}
+
+bool Blob::read(const char *file){
+  FILE *fs = fopen(file, "rb");
+  if(fs == NULL)
+    return false;
+
+  fseek(fs, 0, SEEK_END);
+  long size = ftell(fs);
+  fseek(fs, 0, SEEK_SET);
+  data.resize(size);
+  pos = 0;
+  bool ok = size > 0 && fread(&data[0], 1, size, fs) == size_t(size);
+  fclose(fs);
+  return ok;
+}
+
+//---------------------------------------------------------------------------
+//   CheckpointWriter
+//---------------------------------------------------------------------------
+
+struct CheckpointWriter::Worker{
+  string                  file;
+  std::thread             thread;
+  std::mutex              lock;
+  std::condition_variable wake;
+  vector<char>            pending;
+  bool                    has_pending, done;
+
+  void loop();
+};
+
+CheckpointWriter::CheckpointWriter(const char *file)
+  : worker(new Worker)
+{
+  worker->file = file;
+  worker->has_pending = worker->done = false;
+  worker->thread = std::thread(&Worker::loop, worker);
+}
+
+CheckpointWriter::~CheckpointWriter(){
+  {
+    std::lock_guard<std::mutex> guard(worker->lock);
+    worker->done = true;
+  }
+  worker->wake.notify_one();
+  worker->thread.join();
+  delete worker;
+}
+
+void CheckpointWriter::submit(Blob &blob){
+  {
+    std::lock_guard<std::mutex> guard(worker->lock);
+    worker->pending.swap(blob.data);
+    worker->has_pending = true;
+  }
+  blob.data.clear();
+  blob.pos = 0;
+  worker->wake.notify_one();
+}
+
+void CheckpointWriter::Worker::loop(){
+  string tmp = file + ".tmp";
+  vector<char> image;
+
+  while(true){
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this]{ return has_pending || done; });
+      if(!has_pending)
+        return;
+      image.swap(pending);
+      has_pending = false;
+    }
+
+    FILE *fs = fopen(tmp.c_str(), "wb");
+    bool ok = fs != NULL &&
+              fwrite(&image[0], 1, image.size(), fs) == image.size();
+    if(fs != NULL && fclose(fs) != 0)
+      ok = false;
+    if(ok && rename(tmp.c_str(), file.c_str()) != 0)
+      ok = false;
+    if(!ok)
+      cerr << "checkpoint: unable to write " << file << endl;
+  }
+}
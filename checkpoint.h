@@ -0,0 +1,61 @@
+//---------------------------------------------------------------------------
+#ifndef checkpointH
+#define checkpointH
+//---------------------------------------------------------------------------
+#include <vector>
+#include <string>
+#include <cstring>
+#include "fplan.h"
+//---------------------------------------------------------------------------
+extern char   checkpoint_file[256];   // "" = no checkpoints
+extern double checkpoint_every;       // wall seconds between checkpoints
+extern char   resume_file[256];       // "" = start a new run
+
+const unsigned checkpoint_magic   = 0x4b434251;   // "QBCK"
+const unsigned checkpoint_version = 3;
+
+// Byte image of a run. put*() append, get*() read from "pos" and return
+// false once the image is exhausted.
+class Blob{
+  public:
+    Blob() : pos(0) {}
+
+    template<class T> void put(const T &v){
+      const char *p = (const char*)&v;
+      data.insert(data.end(), p, p+sizeof(T));
+    }
+    template<class T> bool get(T &v){
+      if(pos + sizeof(T) > data.size()) return false;
+      memcpy(&v, &data[pos], sizeof(T));
+      pos += sizeof(T);
+      return true;
+    }
+
+    // B*-tree held in a vector, links stored as indices
+    void put_tree(const vector<Node> &tree);
+    bool get_tree(vector<Node> &tree);
+
+    bool read(const char *file);
+
+    vector<char> data;
+    size_t pos;
+};
+
+/* Writes checkpoint images from a background thread so the move loop only
+   pays for building the image. Only the newest pending image is kept, and
+   the file is replaced by rename() so a crash never leaves half a file.
+*/
+class CheckpointWriter{
+  public:
+    CheckpointWriter(const char *file);
+    ~CheckpointWriter();          // writes what is pending, then joins
+
+    void submit(Blob &blob);      // takes over blob.data
+
+  private:
+    struct Worker;              // thread state, kept out of this header
+    Worker *worker;             // (fplan.h redefines nullptr)
+};
+
+//---------------------------------------------------------------------------
+#endif
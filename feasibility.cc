@@ -0,0 +1,147 @@
+//---------------------------------------------------------------------------
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include "feasibility.h"
+//---------------------------------------------------------------------------
+
+int feasibility_mode = FEASIBILITY_WARN;
+
+int feasibility_by_name(const char *name)
+{
+  static const char *names[] = { "warn", "abort", "relax" };
+  for(int m=FEASIBILITY_WARN; m <= FEASIBILITY_RELAX; m++)
+    if(!strcmp(name, names[m]))
+      return m;
+  return -1;
+}
+
+static long short_side(const Module &m){
+  return min(m.width, m.height);
+}
+
+static long leaf_width(const RECT &r){
+  return labs(r.right - r.left);
+}
+
+static long leaf_height(const RECT &r){
+  return labs(r.top - r.bottom);
+}
+
+static bool known(const Modules &modules, int mod){
+  return mod >= 0 && mod < modules.size();
+}
+
+static void add(vector<ConstraintSlack> &found, int kind, int index,
+                long slack, long relaxed, const char *why)
+{
+  ConstraintSlack s;
+  s.kind = kind;
+  s.index = index;
+  s.slack = slack;
+  s.relaxed = relaxed;
+  s.dangling = false;
+  s.why = why;
+  found.push_back(s);
+}
+
+static void add_dangling(vector<ConstraintSlack> &found, int kind, int index)
+{
+  add(found, kind, index, -1, NIL, "names no module of the design");
+  found.back().dangling = true;
+}
+
+int analyze_constraints(const Constraint &cons, const Modules &modules,
+                        const vector<RECT> &leaves,
+                        vector<ConstraintSlack> &found)
+{
+  int first = found.size();
+  if(leaves.empty())
+    return 0;
+
+  long widest = 0, tallest = 0, longest = 0, biggest = 0, edges = 0;
+  for(int l=0; l < leaves.size(); l++){
+    long w = leaf_width(leaves[l]), h = leaf_height(leaves[l]);
+    widest = max(widest, w);
+    tallest = max(tallest, h);
+    longest = max(longest, max(w, h));
+    biggest = max(biggest, w * h);
+    edges += 2 * (w + h);
+  }
+
+  for(int i=0; i < cons.max_sep.size(); i++){
+    const MAXIMUM_SEPERATION &c = cons.max_sep[i];
+    if(!known(modules, c.mod1) || !known(modules, c.mod2)){
+      add_dangling(found, CONS_MAX_SEP, i);
+      continue;
+    }
+    long need = (short_side(modules[c.mod1]) + short_side(modules[c.mod2]) + 1) / 2;
+    add(found, CONS_MAX_SEP, i, c.dis - need, need,
+        "the modules cannot come that close");
+  }
+
+  for(int i=0; i < cons.range.size(); i++){
+    const RANGE &c = cons.range[i];
+    if(!known(modules, c.mod)){
+      add_dangling(found, CONS_RANGE, i);
+      continue;
+    }
+    if(c.side == RANGE_NONE){
+      add(found, CONS_RANGE, i, -1, NIL, "names no side of the leaf");
+      continue;
+    }
+    bool across = c.side == RANGE_TOP || c.side == RANGE_BOTTOM;
+    long room = (across ? tallest : widest) - short_side(modules[c.mod]);
+    add(found, CONS_RANGE, i, room - c.range, max(0L, room),
+        "no leaf has room for the module past the range");
+  }
+
+  for(int i=0; i < cons.clto_boundary.size(); i++){
+    const CLOSE_TO_BOUNDARY &c = cons.clto_boundary[i];
+    if(!known(modules, c.mod)){
+      add_dangling(found, CONS_CLTO, i);
+      continue;
+    }
+    add(found, CONS_CLTO, i, (longest - 1) / 2 - c.dis, NIL,
+        "no leaf is wider than twice the distance");
+  }
+
+  if(!cons.proximity.empty()){
+    long area = 0;
+    bool dangling = false;
+    for(int i=0; i < cons.proximity.size(); i++){
+      if(!known(modules, cons.proximity[i]))
+        dangling = true;
+      else
+        area += modules[cons.proximity[i]].area;
+    }
+    if(dangling)
+      add_dangling(found, CONS_PROXIMITY, 0);
+    else
+      add(found, CONS_PROXIMITY, 0, biggest - area, NIL,
+          "the group fills more than any leaf");
+  }
+
+  long need = 0;
+  for(int i=0; i < cons.boundary.size(); i++){
+    if(!known(modules, cons.boundary[i]))
+      add_dangling(found, CONS_BOUNDARY, i);
+    else
+      need += short_side(modules[cons.boundary[i]]);
+  }
+  for(int i=0; i < cons.fixed_boundary.size(); i++){
+    if(!known(modules, cons.fixed_boundary[i].mod))
+      add_dangling(found, CONS_FIXED_BOUNDARY, i);
+    else
+      need += short_side(modules[cons.fixed_boundary[i].mod]);
+  }
+  if(!cons.boundary.empty() || !cons.fixed_boundary.empty())
+    add(found, CONS_BOUNDARY, NIL, edges - need, NIL,
+        "the leaf edges are too short for the boundary modules");
+
+  int conflicts = 0;
+  for(int i=first; i < found.size(); i++)
+    if(found[i].slack < 0)
+      conflicts++;
+  return conflicts;
+}
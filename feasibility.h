@@ -0,0 +1,51 @@
+//---------------------------------------------------------------------------
+#ifndef feasibilityH
+#define feasibilityH
+//---------------------------------------------------------------------------
+#include <vector>
+#include "qbtree.h"
+//---------------------------------------------------------------------------
+
+// What to do with a constraint that can never be met (--infeasible=)
+enum FeasibilityMode { FEASIBILITY_WARN=0, FEASIBILITY_ABORT, FEASIBILITY_RELAX };
+
+extern int feasibility_mode;
+
+// FeasibilityMode named "warn", "abort" or "relax", or -1
+int feasibility_by_name(const char *name);
+
+struct ConstraintSlack{
+  int  kind;      // ConsKind
+  int  index;     // in its Constraint list, NIL for the whole kind
+  long slack;     // room left where it fits best; < 0 can never be met
+  long relaxed;   // the value that would just be met, NIL if only dropping
+                  // it helps
+  bool dangling;  // names a module the design does not have
+  const char *why;
+};
+
+/* Load-time check of the constraints against the module sizes and the quad
+   leaves, before anything is packed; modules may turn. Slack is in the
+   constraint's own unit, a distance or, for PROXIMITY, an area:
+
+     MAXIMUM_SEPARATION  the distance, less that of the two centres when
+                         the modules abut on their short sides
+     RANGE               the room between the range and the far side of
+                         the leaf, less the module's short side
+     CLOSE_TO_BOUNDARY   half the longest leaf side, less the distance; a
+                         leaf no wider than twice it has no inside to keep
+                         out of, the check repairs it forever
+     PROXIMITY           the area of the biggest leaf, less the group's
+     BOUNDARY, FIXED_    the leaf edges, less the short sides of the
+     BOUNDARY            modules on them, as one entry for both kinds
+
+   MINIMUM_SEPARATION, SYMMETRY and VARIANT are left to the B*-trees and the
+   islands. Appends an entry for each constraint to "found" and returns the
+   number that can never be met.
+*/
+int analyze_constraints(const Constraint &cons, const Modules &modules,
+                        const vector<RECT> &leaves,
+                        vector<ConstraintSlack> &found);
+
+//---------------------------------------------------------------------------
+#endif
@@ -13,6 +13,7 @@
 #include <climits>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <time.h>
 #include <cassert>
 #include <iostream>
 
@@ -220,22 +221,6 @@ void FPlan::create_network(int size){
     network[p.net].push_back(&p);
   }
 
-  connection.resize(modules_N+1);
-  for(int i=0; i < modules_N+1; i++){
-    connection[i].resize(modules_N+1);
-    fill(connection[i].begin(), connection[i].end(), 0);
-  }
-
-  for(int i=0; i < network.size(); i++){
-    for(int j=0; j < network[i].size()-1; j++){
-      int p= network[i][j]->mod;
-      for(int k=j+1 ; k < network[i].size(); k++){
-        int q= network[i][k]->mod;
-        connection[p][q]++;
-        connection[q][p]++;   
-      }
-    }
-  }
 }
 
 
@@ -364,23 +349,59 @@ void FPlan::list_information(){
 //   Auxilliary Functions
 //---------------------------------------------------------------------------
 
-void error(char *msg,char *msg2){
+void error(const char *msg,const char *msg2){
   printf(msg,msg2);
   cout << endl;
   throw 1;
 }
 
+//   Random numbers: splitmix64, whose whole state is one word so that a
+//   run can be checkpointed and resumed exactly.
+static uint64_t rand_state = 0x853c49e6748fea9bULL;
+
+void rand_seed(uint64_t seed){
+  rand_state = seed;
+}
+
+uint64_t rand_get_state(){
+  return rand_state;
+}
+
+void rand_set_state(uint64_t state){
+  rand_state = state;
+}
+
+static inline uint64_t rand_next(){
+  uint64_t z = (rand_state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// uniform in [0,n)
+int rand_int(int n){
+  return int(rand_next() % uint64_t(n));
+}
+
 bool rand_bool(){
-  return bool(rand()%2);
+  return bool(rand_int(2));
 }
 
 float rand_01(){
-  return float(rand()%10000)/10000;
+  return float(rand_int(10000))/10000;
 }
 
+// user CPU time of this process
 double seconds(){
    rusage time;
    getrusage(RUSAGE_SELF,&time);
    return (double)(1.0*time.ru_utime.tv_sec+0.000001*time.ru_utime.tv_usec);
 }
 
+// monotonic wall clock, for budgets and anything threaded
+double wall_seconds(){
+   timespec t;
+   clock_gettime(CLOCK_MONOTONIC,&t);
+   return (double)(1.0*t.tv_sec+1e-9*t.tv_nsec);
+}
+
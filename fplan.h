@@ -15,6 +15,7 @@
 #include <map>
 #include <cstdio>
 #include <cstddef>
+#include <stdint.h>
 
 #define nullptr NULL
 //---------------------------------------------------------------------------
@@ -59,6 +60,7 @@ typedef vector<Module_Info> Modules_Info;
 
 struct Node{
   int id;
+  int heap;     // index in its B_Tree's heap_nodes, if made by new_node()
   Node *parent,*left,*right;
   bool rotate,flip;
   float ratio;
@@ -97,6 +99,10 @@ class FPlan{
 
     void                    setModules(Modules modules) { this->modules = modules; modules_N = modules.size(); }
     void                    setRootModule(Module module){ this->root_module = module;   }
+    // a module standing in for a block of others, see symmetry.h
+    void                    setModuleSize(int id, int width, int height) {
+                              modules[id].width = width; modules[id].height = height;
+                              modules[id].area = width * height; }
 
     float  getDeadSpace();
 
@@ -129,7 +135,6 @@ class FPlan{
     Nets network;
     double norm_area, norm_wire;
     float cost_alpha;
-    vector<vector<int> > connection;
     
   private:
     void read_dimension(Module&);
@@ -141,10 +146,15 @@ class FPlan{
 };
 
 
-void error(char *msg,char *msg2="");
+void error(const char *msg,const char *msg2="");
+void rand_seed(uint64_t seed);
+uint64_t rand_get_state();
+void rand_set_state(uint64_t state);
+int rand_int(int n);
 bool rand_bool();
 float rand_01();
 double seconds();
+double wall_seconds();
       
 //---------------------------------------------------------------------------
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "memstat.h"
+//---------------------------------------------------------------------------
+MemCounter mem_pools[MEM_POOLS];
+
+static const char *pool_names[MEM_POOLS] = {
+  "nodes", "snapshots", "btrees"
+};
+
+static long samples, first_rss, last_rss, max_rss;
+
+long mem_rss_kb(){
+  FILE *fs = fopen("/proc/self/statm", "r");
+  if(fs == NULL)
+    return 0;
+  long size, resident;
+  int n = fscanf(fs, "%ld %ld", &size, &resident);
+  fclose(fs);
+  return n == 2 ? resident * (sysconf(_SC_PAGESIZE) / 1024) : 0;
+}
+
+// ru_maxrss and statm count pages apart, so the peak takes in a sample of
+// its own and is never below the resident set just read
+long mem_peak_rss_kb(){
+  long peak = max_rss, rss = mem_rss_kb();
+  struct rusage ru;
+  if(getrusage(RUSAGE_SELF, &ru) == 0 && ru.ru_maxrss > peak)
+    peak = ru.ru_maxrss;   // KB on Linux
+  return rss > peak ? rss : peak;
+}
+
+void mem_sample(){
+  long rss = mem_rss_kb();
+  if(samples++ == 0)
+    first_rss = rss;
+  last_rss = rss;
+  if(rss > max_rss)
+    max_rss = rss;
+}
+
+void memory_report(){
+  printf("\n %-10s %12s %12s %10s %10s\n",
+         "memory", "bytes", "peak", "allocs", "frees");
+  for(int i=0; i < MEM_POOLS; i++){
+    MemCounter &c = mem_pools[i];
+    printf(" %-10s %12ld %12ld %10ld %10ld\n", pool_names[i],
+           c.bytes, c.peak, c.allocs, c.frees);
+  }
+  long rss = mem_rss_kb(), peak = mem_peak_rss_kb();
+  printf(" RSS %ld KB, peak %ld KB", rss, peak > rss ? peak : rss);
+  if(samples > 1)
+    printf(", %ld -> %ld KB over %ld temperatures", first_rss, last_rss,
+           samples);
+  printf("\n");
+}
@@ -0,0 +1,44 @@
+//---------------------------------------------------------------------------
+#ifndef memstatH
+#define memstatH
+//---------------------------------------------------------------------------
+
+/* Byte counters of the long-lived allocations of each subsystem, and the
+   resident set size of the process. The counters are kept by the owners of
+   the memory (B*-tree nodes, solution snapshots, B*-tree objects), so a
+   pool that keeps growing over a long run is a leak in that subsystem.
+*/
+
+enum MemPool { MEM_NODES=0, MEM_SNAPSHOTS, MEM_BTREES, MEM_POOLS };
+
+struct MemCounter{
+  long bytes;           // held now
+  long peak;            // most held at once
+  long allocs, frees;
+};
+
+extern MemCounter mem_pools[MEM_POOLS];
+
+inline void mem_alloc(int pool, long bytes){
+  MemCounter &c = mem_pools[pool];
+  c.bytes += bytes;
+  c.allocs++;
+  if(c.bytes > c.peak)
+    c.peak = c.bytes;
+}
+
+inline void mem_free(int pool, long bytes){
+  MemCounter &c = mem_pools[pool];
+  c.bytes -= bytes;
+  c.frees++;
+}
+
+long mem_rss_kb();        // resident set now, 0 if unknown
+long mem_peak_rss_kb();   // high-water mark of the resident set
+void mem_sample();        // note the resident set, once per temperature
+
+// Table on stdout; the run's first and last samples show any growth.
+void memory_report();
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,289 @@
+// Kernel microbenchmarks: times the B*-tree and QB-tree kernels one at a
+// time on random designs of growing size, built from a seed.
+//
+//   microbench [--seed=N] [--sizes=10,100,1000,10000,50000]
+//              [--min-time=S] [--json=FILE]
+//
+// Every kernel is repeated until it has run for min-time seconds (at
+// least once); the mean time per call is reported for every size, so
+// each row of the table is the kernel's scaling curve. The quadratic
+// QB-tree kernels take several seconds per call at 50k modules.
+
+//---------------------------------------------------------------------------
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include "btree.h"
+#include "qbtree.h"
+//---------------------------------------------------------------------------
+
+static double min_time = 0.2;
+static long   max_reps = 100000;
+
+// B*-tree with its protected kernels opened up
+struct BenchTree : public B_Tree{
+  BenchTree() : B_Tree(1) {}
+
+  using FPlan::calcWireLength;
+
+  // the placement loop of packing(), without the area and wirelength
+  void place_all(const vector<Node*> &nodes){
+    clear();
+    place_module(nodes[0], nullptr);
+    for(int i=1; i < nodes.size(); i++){
+      Node *n = nodes[i];
+      place_module(n, n->parent, n->parent->left == n);
+    }
+  }
+};
+
+struct Design{
+  Modules mods;
+  Module  root;
+  int     nets;
+};
+
+/* n modules of 10..200 x 10..200, one net per module with 2..5 pins on
+   random modules, and 8 IO pads on the outline.
+*/
+static void make_design(int n, Design &d)
+{
+  d.mods.resize(n);
+  d.nets = n;
+  double total = 0;
+  for(int i=0; i < n; i++){
+    Module &m = d.mods[i];
+    m.id = i;
+    sprintf(m.name, "m%d", i);
+    m.width  = 10 + rand_int(191);
+    m.height = 10 + rand_int(191);
+    m.x = m.y = 0;
+    m.area = m.width * m.height;
+    m.type = MT_Hard;
+    total += m.area;
+  }
+
+  for(int net=0; net < d.nets; net++){
+    int degree = 2 + rand_int(4);
+    for(int j=0; j < degree; j++){
+      Module &m = d.mods[rand_int(n)];
+      Pin p(rand_int(m.width), rand_int(m.height));
+      p.mod = m.id;
+      p.net = net;
+      m.pins.push_back(p);
+    }
+  }
+
+  Module &r = d.root;
+  r.id = n;
+  strcpy(r.name, "PARENT");
+  r.width = r.height = int(sqrt(total * 1.2));
+  r.x = r.y = 0;
+  r.area = r.width * r.height;
+  r.type = MT_Hard;
+  r.pins.clear();
+  for(int i=0; i < 8; i++){
+    Pin p(i < 4 ? 0 : r.width, rand_int(r.height));
+    p.mod = n;
+    p.net = rand_int(d.nets);
+    r.pins.push_back(p);
+  }
+}
+
+struct Result{
+  const char *kernel;
+  int    n;
+  long   reps;
+  double mean;          // seconds per call
+};
+
+static vector<Result> results;
+
+template<class F>
+static void run(const char *kernel, int n, F f)
+{
+  long reps = 0;
+  double start = wall_seconds(), t;
+  do{
+    f();
+    reps++;
+    t = wall_seconds() - start;
+  }while(t < min_time && reps < max_reps);
+
+  Result r = { kernel, n, reps, t / reps };
+  results.push_back(r);
+  printf("  %-22s n=%-6d reps=%-7ld %12.2f us\n", kernel, n, reps, r.mean*1e6);
+  fflush(stdout);
+}
+
+static void bench_btree(const Design &d)
+{
+  int n = d.mods.size();
+  BenchTree bt;
+  bt.setModules(d.mods);
+  bt.setRootModule(d.root);
+  bt.create_network(d.nets);
+
+  // complete binary tree over shuffled modules, then random moves
+  vector<int> inds(n);
+  for(int i=0; i < n; i++) inds[i] = i;
+  for(int i=n-1; i > 0; i--) swap(inds[i], inds[rand_int(i+1)]);
+  bt.init();
+  bt.initWithNodeIndices(inds);
+  for(int i=0; i < min(n, 200); i++)
+    bt.perturb();
+  bt.packing();
+
+  vector<Node*> nodes = bt.allnodes();
+  run("btree.packing",      n, [&]{ bt.packing(); });
+  run("btree.place_module", n, [&]{ bt.place_all(nodes); });
+  results.back().mean /= n;     // per placed module
+  run("btree.wirelength",   n, [&]{ bt.calcWireLength(); });
+  run("btree.keep_sol",     n, [&]{ bt.keep_sol(); });
+  run("btree.recover",      n, [&]{ bt.recover(); });
+  run("btree.perturb",      n, [&]{ bt.perturb(); });
+}
+
+static void bench_qbtree(const Design &d)
+{
+  int n = d.mods.size();
+  QBtree *qb = new QBtree;
+  qb->alpha = 1;
+  qb->modules = d.mods;
+  qb->modules_N = n;
+  qb->root_module = d.root;
+  for(int i=0; i < d.nets; i++){
+    char name[20];
+    sprintf(name, "n%d", i);
+    qb->net_table[name] = i;
+  }
+  qb->modules_info.resize(n);
+  qb->create_network();
+  qb->constructQBTree();
+  qb->packing();
+  for(int i=0; i < 20; i++)     // spread modules over the quad leaves
+    qb->perturb();
+  qb->lastSolution.cost = NIL;
+  qb->keep_sol(qb->lastSolution);
+
+  // a few constraints of each kind the violation cost looks at
+  Constraint synth;
+  int k = max(1, n / 100);
+  for(int i=0; i < k; i++){
+    MAXIMUM_SEPERATION ms = { rand_int(n), rand_int(n), 100 + rand_int(1000) };
+    synth.max_sep.push_back(ms);
+    RANGE rg;
+    rg.mod = rand_int(n);
+    strcpy(rg.boundary, "TOP");
+    rg.side = RANGE_TOP;
+    rg.range = 500;
+    synth.range.push_back(rg);
+    CLOSE_TO_BOUNDARY cb = { rand_int(n), 300 };
+    synth.clto_boundary.push_back(cb);
+  }
+
+  run("qbtree.packing",     n, [&]{ qb->packing(); });
+  run("qbtree.wirelength",  n, [&]{ qb->calcWireLength(); });
+  run("qbtree.area",        n, [&]{ qb->calcNormalizeArea(); });
+  swap(qb->constraints, synth);
+  run("qbtree.violation",   n, [&]{ qb->reset_violation(); qb->calcViolationCost(); });
+  run("qbtree.violation_inc", n, [&]{ qb->calcViolationCost(); });
+  swap(qb->constraints, synth);
+  qb->reset_violation();
+  run("qbtree.keep_sol",    n, [&]{ qb->keep_sol(qb->lastSolution); });
+  run("qbtree.recover",     n, [&]{ qb->recover(qb->lastSolution); });
+  run("qbtree.perturb",     n, [&]{ qb->perturb(); });
+  delete qb;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t seed = 1;
+  vector<int> sizes = { 10, 100, 1000, 10000, 50000 };
+  const char *json = NULL;
+
+  for(int i=1; i < argc; i++){
+    const char *value = strchr(argv[i], '=');
+    value = value ? value+1 : "";
+    if(!strncmp(argv[i], "--seed=", 7))
+      seed = strtoull(value, NULL, 10);
+    else if(!strncmp(argv[i], "--min-time=", 11))
+      min_time = atof(value);
+    else if(!strncmp(argv[i], "--json=", 7))
+      json = value;
+    else if(!strncmp(argv[i], "--sizes=", 8)){
+      sizes.clear();
+      for(const char *p = value; *p; ){
+        sizes.push_back(atoi(p));
+        p = strchr(p, ',');
+        if(!p) break;
+        p++;
+      }
+    }
+    else{
+      printf("Usage: microbench [--seed=N] [--sizes=N,N,...] "
+             "[--min-time=S] [--json=FILE]\n");
+      return 0;
+    }
+  }
+
+  for(int i=0; i < sizes.size(); i++){
+    int n = sizes[i];
+    if(n < 4){
+      printf("size %d too small, skipped\n", n);
+      continue;
+    }
+    printf("n = %d\n", n);
+    Design d;
+    rand_seed(seed);
+    make_design(n, d);
+    rand_seed(seed);
+    bench_btree(d);
+    rand_seed(seed);
+    bench_qbtree(d);
+  }
+
+  // scaling curves: one row per kernel, microseconds per call
+  vector<const char*> kernels;
+  for(int i=0; i < results.size(); i++){
+    bool seen = false;
+    for(int j=0; j < kernels.size(); j++)
+      seen |= !strcmp(kernels[j], results[i].kernel);
+    if(!seen) kernels.push_back(results[i].kernel);
+  }
+  printf("\n%-22s", "us/call");
+  for(int i=0; i < sizes.size(); i++)
+    if(sizes[i] >= 4) printf(" %11d", sizes[i]);
+  printf("   exponent\n");
+  for(int k=0; k < kernels.size(); k++){
+    printf("%-22s", kernels[k]);
+    const Result *first = NULL, *last = NULL;
+    for(int i=0; i < results.size(); i++){
+      if(strcmp(results[i].kernel, kernels[k])) continue;
+      printf(" %11.2f", results[i].mean*1e6);
+      if(!first) first = &results[i];
+      last = &results[i];
+    }
+    // slope of log(time) over log(n) between the smallest and largest size
+    if(last != first && first->mean > 0)
+      printf("   %8.2f", log(last->mean/first->mean) / log(double(last->n)/first->n));
+    printf("\n");
+  }
+
+  if(json){
+    FILE *fs = fopen(json, "w");
+    if(fs == NULL){
+      printf("unable to open %s\n", json);
+      return 1;
+    }
+    fprintf(fs, "{\"seed\":%llu,\"results\":[", (unsigned long long)seed);
+    for(int i=0; i < results.size(); i++)
+      fprintf(fs, "%s\n {\"kernel\":\"%s\",\"n\":%d,\"reps\":%ld,\"mean\":%.9g}",
+              i ? "," : "", results[i].kernel, results[i].n, results[i].reps,
+              results[i].mean);
+    fprintf(fs, "\n]}\n");
+    fclose(fs);
+  }
+  return 0;
+}
@@ -0,0 +1,248 @@
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <new>
+#include "profile.h"
+#include "fplan.h"
+#if defined(QB_PROFILE) && defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+//---------------------------------------------------------------------------
+char profile_file[256] = "";
+bool profile_counters = false;
+
+#ifdef QB_PROFILE
+
+static const char *phase_names[PROF_PHASES] =
+  { "perturb", "repair", "packing", "cost", "keep_sol", "recover" };
+
+PhaseStats prof_phases[PROF_PHASES];
+
+static long       allocs_seen = 0;
+static ProfScope *innermost = NULL;
+
+// Counting operator new. The checkpoint writer thread allocates too, so the
+// count is only approximate while it is busy.
+void* operator new(size_t size){
+  __atomic_add_fetch(&allocs_seen, 1, __ATOMIC_RELAXED);
+  void *p = malloc(size ? size : 1);
+  if(p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+long prof_alloc_count(){
+  return __atomic_load_n(&allocs_seen, __ATOMIC_RELAXED);
+}
+
+//---------------------------------------------------------------------------
+//   Hardware counters
+//---------------------------------------------------------------------------
+
+static const char *counter_names[PROF_COUNTERS] =
+  { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+
+// All counters are one group led by the first that opened, so a single
+// read() returns them together; slot[] is a counter's place in that read.
+static int group_fd = -1;
+static int group_size = 0;
+static int slot[PROF_COUNTERS];
+
+#ifdef __linux__
+
+// The counters now; all zero, and false, when the group cannot be read.
+static bool read_counters(unsigned long long *v){
+  memset(v, 0, sizeof(v[0]) * PROF_COUNTERS);
+  if(group_fd < 0)
+    return false;
+  unsigned long long buf[1 + PROF_COUNTERS];
+  if(read(group_fd, buf, sizeof(buf)) < ssize_t(sizeof(buf[0]) * (1 + group_size)))
+    return false;
+  for(int i=0; i < PROF_COUNTERS; i++)
+    v[i] = slot[i] < 0 ? 0 : buf[1 + slot[i]];
+  return true;
+}
+
+static int open_counter(int counter, int leader){
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch(counter){
+    case PERF_CYCLES:        attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case PERF_INSTRUCTIONS:  attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case PERF_LLC_MISSES:    attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+    case PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    case PERF_L1D_MISSES:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+  }
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.disabled = leader < 0;
+  attr.exclude_kernel = 1;        // allowed at perf_event_paranoid 2
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+void profile_start(){
+  if(!profile_counters || group_fd >= 0)
+    return;
+  int err = 0;
+  for(int i=0; i < PROF_COUNTERS; i++){
+    int fd = open_counter(i, group_fd);
+    if(fd < 0){
+      slot[i] = -1;
+      err = errno;
+      continue;
+    }
+    if(group_fd < 0)
+      group_fd = fd;
+    slot[i] = group_size++;
+  }
+  if(group_fd < 0){
+    printf("hardware counters unavailable (%s), timings only\n",
+           strerror(err));
+    profile_counters = false;
+    return;
+  }
+  for(int i=0; i < PROF_COUNTERS; i++)
+    if(slot[i] < 0)
+      printf("hardware counter %s unavailable\n", counter_names[i]);
+  ioctl(group_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+#else
+
+static bool read_counters(unsigned long long *v){
+  memset(v, 0, sizeof(v[0]) * PROF_COUNTERS);
+  return false;
+}
+
+void profile_start(){
+  if(profile_counters)
+    printf("hardware counters need Linux, timings only\n");
+  profile_counters = false;
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+//   Phases
+//---------------------------------------------------------------------------
+
+ProfScope::ProfScope(int phase)
+  : phase(phase), child(0), allocs(prof_alloc_count()), outer(innermost)
+{
+  innermost = this;
+  if(group_fd >= 0){
+    memset(cchild, 0, sizeof(cchild));
+    read_counters(cstart);
+  }
+  start = wall_seconds();
+}
+
+ProfScope::~ProfScope(){
+  double spent = wall_seconds() - start;
+  PhaseStats &s = prof_phases[phase];
+  s.calls++;
+  s.total += spent;
+  s.self += spent - child;
+  s.allocs += prof_alloc_count() - allocs;
+  if(group_fd >= 0){
+    unsigned long long now[PROF_COUNTERS];
+    if(!read_counters(now))   // a failed read counts nothing
+      memcpy(now, cstart, sizeof(now));
+    for(int i=0; i < PROF_COUNTERS; i++){
+      unsigned long long used = now[i] - cstart[i];
+      s.counts[i] += used - cchild[i];
+      if(outer)
+        outer->cchild[i] += used;
+    }
+  }
+  if(outer)
+    outer->child += spent;
+  innermost = outer;
+}
+
+void profile_report(){
+  printf("\n %-10s %10s %10s %10s %10s %10s\n",
+         "phase", "calls", "total(s)", "self(s)", "mean(us)", "allocs");
+  for(int i=0; i < PROF_PHASES; i++){
+    PhaseStats &s = prof_phases[i];
+    printf(" %-10s %10ld %10.3f %10.3f %10.2f %10ld\n", phase_names[i],
+           s.calls, s.total, s.self, s.calls ? s.total/s.calls*1e6 : 0.0,
+           s.allocs);
+  }
+
+  if(group_fd >= 0){
+    printf("\n %-10s", "self");
+    for(int j=0; j < PROF_COUNTERS; j++)
+      printf(" %13s", counter_names[j]);
+    printf(" %6s\n", "IPC");
+    for(int i=0; i < PROF_PHASES; i++){
+      PhaseStats &s = prof_phases[i];
+      printf(" %-10s", phase_names[i]);
+      for(int j=0; j < PROF_COUNTERS; j++)
+        if(slot[j] < 0) printf(" %13s", "-");
+        else            printf(" %13llu", s.counts[j]);
+      if(slot[PERF_CYCLES] >= 0 && slot[PERF_INSTRUCTIONS] >= 0 &&
+         s.counts[PERF_CYCLES])
+        printf(" %6.2f", double(s.counts[PERF_INSTRUCTIONS]) /
+                         s.counts[PERF_CYCLES]);
+      printf("\n");
+    }
+  }
+
+  if(!profile_file[0])
+    return;
+  FILE *fs = fopen(profile_file, "w");
+  if(fs == NULL){
+    printf("unable to open profile file: %s\n", profile_file);
+    return;
+  }
+  fprintf(fs, "{\"phases\":[");
+  for(int i=0; i < PROF_PHASES; i++){
+    PhaseStats &s = prof_phases[i];
+    fprintf(fs, "%s\n {\"phase\":\"%s\",\"calls\":%ld,\"total\":%.6f,"
+                "\"self\":%.6f,\"mean\":%.9f,\"allocs\":%ld",
+            i ? "," : "", phase_names[i], s.calls, s.total, s.self,
+            s.calls ? s.total/s.calls : 0.0, s.allocs);
+    for(int j=0; j < PROF_COUNTERS; j++)
+      if(group_fd >= 0 && slot[j] >= 0)
+        fprintf(fs, ",\"%s\":%llu", counter_names[j], s.counts[j]);
+    fprintf(fs, "}");
+  }
+  fprintf(fs, "\n]}\n");
+  fclose(fs);
+}
+
+#else
+
+static bool read_counters(unsigned long long *v){
+  memset(v, 0, sizeof(v[0]) * PROF_COUNTERS);
+  return false;
+}
+
+void profile_start(){
+  if(profile_counters)
+    printf("built without profiling, use make PROFILE=1\n");
+  profile_counters = false;
+}
+
+void profile_report(){
+  if(profile_file[0])
+    printf("built without profiling, use make PROFILE=1\n");
+}
+
+#endif
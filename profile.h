@@ -0,0 +1,68 @@
+//---------------------------------------------------------------------------
+#ifndef profileH
+#define profileH
+//---------------------------------------------------------------------------
+
+/* Per-phase timers and counters for the move loop, built only with
+   -DQB_PROFILE (make PROFILE=1); otherwise PROFILE_PHASE() is empty.
+
+   PROFILE_PHASE(p) times the rest of the enclosing block. Phases nest:
+   "total" includes the phases called from inside, "self" does not.
+   Allocations count calls of operator new.
+
+   With profile_counters set, the hardware counters below are read at the
+   edges of every phase through perf_event_open(2) and reported as self
+   counts. Where the kernel or the machine does not offer them (no PMU,
+   perf_event_paranoid, not Linux), the run goes on with timings only.
+*/
+
+enum ProfPhase { PROF_PERTURB=0, PROF_REPAIR, PROF_PACKING, PROF_COST,
+                 PROF_KEEP_SOL, PROF_RECOVER, PROF_PHASES };
+
+enum ProfCounter { PERF_CYCLES=0, PERF_INSTRUCTIONS, PERF_L1D_MISSES,
+                   PERF_LLC_MISSES, PERF_BRANCH_MISSES, PROF_COUNTERS };
+
+extern char profile_file[256];          // JSON report, "" = none
+extern bool profile_counters;           // --perf-counters
+
+// Opens the counters when profile_counters is set; says why if it cannot.
+void profile_start();
+
+// Table on stdout and JSON to profile_file; does nothing without QB_PROFILE.
+void profile_report();
+
+#ifdef QB_PROFILE
+
+struct PhaseStats{
+  long   calls;
+  double total, self;     // seconds
+  long   allocs;
+  unsigned long long counts[PROF_COUNTERS];   // self
+};
+
+extern PhaseStats prof_phases[PROF_PHASES];
+long prof_alloc_count();
+
+class ProfScope{
+  public:
+    ProfScope(int phase);
+    ~ProfScope();
+
+  private:
+    int       phase;
+    double    start, child;
+    long      allocs;
+    unsigned long long cstart[PROF_COUNTERS], cchild[PROF_COUNTERS];
+    ProfScope *outer;
+};
+
+#define PROFILE_PHASE(p) ProfScope prof_scope(p)
+
+#else
+
+#define PROFILE_PHASE(p)
+
+#endif
+
+//---------------------------------------------------------------------------
+#endif
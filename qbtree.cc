@@ -1,6 +1,13 @@
 #include <stack>
 #include <algorithm>
 #include "qbtree.h"
+#include "annealer.h"
+#include "checkpoint.h"
+#include "profile.h"
+#include "memstat.h"
+#include "trajectory.h"
+#include "verify.h"
+#include "feasibility.h"
 #include <iostream>
 #include <climits>
 #include <algorithm>    // std::min
@@ -17,6 +24,7 @@ void QBtree::init(float alpha, char* filename, int times, int local, float term_
     QBtree::times = times;
     QBtree::local = local;
     QBtree::term_temp = term_temp;
+    placed_stale = true;
 
     char constraint_file[80];
     strcpy(constraint_file, filename);
@@ -30,6 +38,18 @@ void QBtree::init(float alpha, char* filename, int times, int local, float term_
 
     // Read Constraint.
     readConstraint(constraint_file);
+    check_feasibility();
+    build_islands();
+    cluster_modules();
+    pin_modules();
+    index_constraints();
+    memset(repair_stats, 0, sizeof(repair_stats));
+    memset(step_start, 0, sizeof(step_start));
+    memset(violation_parts, 0, sizeof(violation_parts));
+    memset(step_violation, 0, sizeof(step_violation));
+    step_moves = 0;
+    proposals = perturbations = fallbacks = 0;
+    longest_chain = 0;
 
     // standard_cost.
     normalize_cost(10);
@@ -144,23 +164,6 @@ void QBtree::create_network() {
         Pin& p = root_module.pins[j];
         network[p.net].push_back(&p);
     }
-
-    connection.resize(modules_N + 1);
-    for (int i = 0; i < modules_N + 1; i++) {
-        connection[i].resize(modules_N + 1);
-        fill(connection[i].begin(), connection[i].end(), 0);
-    }
-
-    for (int i = 0; i < network.size(); i++) {
-        for (int j = 0; j < network[i].size() - 1; j++) {
-            int p = network[i][j]->mod;
-            for (int k = j + 1; k < network[i].size(); k++) {
-                int q = network[i][k]->mod;
-                connection[p][q]++;
-                connection[q][p]++;
-            }
-        }
-    }
 }
 
 //********** Retrieve Newtork Information from input file **********//
@@ -194,13 +197,27 @@ void QBtree::read_network() {
     }
 }
 
+int range_side(const char* boundary)
+{
+    static const char* names[] = { "TOP", "BOTTOM", "LEFT", "RIGHT" };
+    for (int k = RANGE_TOP; k < RANGE_NONE; k++)
+        if (strcmp(boundary, names[k]) == 0)
+            return k;
+    return RANGE_NONE;
+}
+
 //********** Retrieve constraint data from constraint file **********//
 void QBtree::readConstraint(char* file)
 {
     char* token;
     fs.open(file);
     if (fs.fail())
-        error("unable to open file: %s", file);
+    {
+        // designs without a constraint file are placed unconstrained
+        cout << "no constraint file " << file << ", no constraints" << endl;
+        fs.clear();
+        return;
+    }
 
     while (!fs.eof())
     {
@@ -208,11 +225,14 @@ void QBtree::readConstraint(char* file)
         if (strcmp(t1, "SYMMETRY") == 0)
             //SYMMETRY CONSTRAINT.
         {
+            // each section is one group
+            int group = constraints.symmetry.empty() ? 0 : constraints.symmetry.back().group + 1;
             while (!fs.eof())
             {
                 SYMMETRY sym;
                 sym.mod1 = NIL;
                 sym.mod2 = NIL;
+                sym.group = group;
                 fs >> t1;
                 if (strcmp(t1, "END") == 0)
                     break;
@@ -239,15 +259,13 @@ void QBtree::readConstraint(char* file)
                 }
                 else
                 {
+                    // every module of the list is self-symmetric
                     token = strtok(t1, ",");
                     while (token != NULL)
                     {
-                        if (sym.mod1 == NIL)
-                        {
-                            sym.mod1 = find_mod_id_with_module_name(token);
-                            sym.mod2 = NIL;
-                            constraints.symmetry.push_back(sym);
-                        }
+                        sym.mod1 = find_mod_id_with_module_name(token);
+                        sym.mod2 = NIL;
+                        constraints.symmetry.push_back(sym);
                         token = strtok(NULL, ",");
                     }
                 }
@@ -362,6 +380,7 @@ void QBtree::readConstraint(char* file)
                 range.mod = find_mod_id_with_module_name(t1);
                 fs >> t1;
                 strcpy(range.boundary, t1);
+                range.side = range_side(t1);
                 fs >> t1;
                 tail(t1);
                 range.range = atoi(t1);
@@ -790,6 +809,16 @@ void QBtree::constructQBTree()
 
     // Split Quad-tree.
     qSplit(0, rects);
+    vector<RECT> leaves;
+    for (int i = 0; i < qbnodes.size(); i++)
+    {
+        if (qbnodes[i].isleaf())
+        {
+            quad_leaves.push_back(i);
+            leaves.push_back(qbnodes[i].boundRect);
+        }
+    }
+    leaf_grid.build(qbnodes[0].boundRect, leaves);
 
     // Make one B*-tree with all modules and add to Quad-tree leaf.
     QBTreeNode* qnode = find_big_leaf();
@@ -848,6 +877,8 @@ void QBtree::initBTree(B_Tree& fp)
     fp.variants = constraints.variant;
     fp.min_seps = constraints.min_sep;
     fp.fixed_bndries = constraints.fixed_boundary;
+    fp.pinned = pinned_mods;
+    resize_islands(fp);
 }
 
 //********** Leads to function that constructs B*-tree **********//
@@ -883,7 +914,7 @@ QBTreeNode* QBtree::find_leaf_random()
         return nullptr;
     do
     {
-        i = rand() % qbnodes.size();
+        i = rand_int(qbnodes.size());
     } while (!qbnodes[i].isleaf());
 
     return &qbnodes[i];
@@ -904,6 +935,15 @@ void QBtree::perturb()
     bool movetoleaf;
     bool movetob;
     bool swap;
+    if (trajectory.recording())
+        trajectory.perturbation();
+    // now and then rearrange a symmetry island instead of the trees
+    if (!islands.empty() && rand_int(4) == 0)
+    {
+        perturb_island();
+        packing();
+        return;
+    }
     // Randomly perturb flags setting.
     do {
         movetoleaf = rand_bool();
@@ -957,24 +997,240 @@ void QBtree::normalize_cost(int time)
     cout << "normalize Cost : " << normal_cost << " , min_cost : " << cost_min << endl;
 }
 
+int repair_retries = 1000;
+
 void QBtree::perturbation()
 {
-    // perturb
-    perturb();
-    // constraint checking & candidate generation.
-    if (!constraintChecking())
+    proposals++;
+    for (int tries = 1; ; tries++)
+    {
+        // perturb
+        perturb();
+        perturbations++;
+        longest_chain = max(longest_chain, tries);
+        // constraint checking & candidate generation.
+        if (constraintChecking())
+            return;
+        // if candidate generation failed, perturb again, up to the limit;
+        // past it the move is costed with what calcViolationCost() finds
+        if (repair_retries > 0 && tries >= repair_retries)
+        {
+            fallbacks++;
+            return;
+        }
+    }
+}
+
+//********** Constraint Repair Statistics **********//
+const char* cons_kind_names[CONS_KINDS] = {
+    "max_sep", "range", "clto", "proximity", "boundary", "fixed"
+};
+
+int QBtree::count_constraints(int kind)
+{
+    switch (kind)
+    {
+    case CONS_MAX_SEP:          return constraints.max_sep.size();
+    case CONS_RANGE:            return constraints.range.size();
+    case CONS_CLTO:             return constraints.clto_boundary.size();
+    case CONS_PROXIMITY:        return !constraints.proximity.empty();
+    case CONS_BOUNDARY:         return constraints.boundary.size();
+    case CONS_FIXED_BOUNDARY:   return constraints.fixed_boundary.size();
+    }
+    return 0;
+}
+
+// Checks, repairs and their time by kind, with the violation cost each
+// kind adds to the placement as last packed.
+void QBtree::repair_report()
+{
+    printf("\n %-10s %10s %10s %10s %10s %10s %9s %10s\n", "repair",
+           "checks", "skipped", "violated", "repairs", "failures", "seconds",
+           "violation");
+    for (int k = 0; k < CONS_KINDS; k++)
+    {
+        RepairStats& r = repair_stats[k];
+        if (count_constraints(k) == 0)
+            continue;
+        printf(" %-10s %10ld %10ld %10ld %10ld %10ld %9.3f %10.4f\n",
+               cons_kind_names[k], r.checks, r.skipped, r.violations,
+               r.repairs, r.failures, r.seconds, violation_parts[k]);
+    }
+    printf(" %ld moves, %ld perturbations (%.2f a move, longest %d), "
+           "%ld past the limit of %d\n", proposals, perturbations,
+           proposals ? double(perturbations) / proposals : 0.0,
+           longest_chain, fallbacks, repair_retries);
+}
+
+// Telemetry of a temperature step: by kind, the mean violation cost of
+// its moves and the checks made in it. Starts the next step.
+const char* QBtree::step_fields()
+{
+    char field[256];
+    step_json.clear();
+    for (int k = 0; k < CONS_KINDS; k++)
+    {
+        if (count_constraints(k) == 0)
+            continue;
+        RepairStats& r = repair_stats[k];
+        RepairStats& s = step_start[k];
+        snprintf(field, sizeof(field), "%s\"%s\":{\"violation\":%.6g,"
+                 "\"checks\":%ld,\"violated\":%ld,\"repairs\":%ld,"
+                 "\"failures\":%ld,\"seconds\":%.6f}",
+                 step_json.empty() ? "\"constraints\":{" : ",",
+                 cons_kind_names[k],
+                 step_moves ? step_violation[k] / step_moves : 0.0,
+                 r.checks - s.checks, r.violations - s.violations,
+                 r.repairs - s.repairs, r.failures - s.failures,
+                 r.seconds - s.seconds);
+        step_json += field;
+        s = r;
+        step_violation[k] = 0;
+    }
+    if (!step_json.empty())
+        step_json += "}";
+    step_moves = 0;
+    return step_json.c_str();
+}
+
+//********** Constraint Feasibility **********//
+// Before annealing, the constraints the partition can never meet are
+// reported (feasibility.h), then, as --infeasible= says, left to the
+// repairs, relaxed to the nearest value that can be met, or the run ends.
+// Those naming a module the design does not have are dropped in any case,
+// nothing could check them.
+void QBtree::check_feasibility()
+{
+    vector<RECT> leaves;
+    for (int l = 0; l < quad_leaves.size(); l++)
+        leaves.push_back(qbnodes[quad_leaves[l]].boundRect);
+    vector<ConstraintSlack> found;
+    int conflicts = analyze_constraints(constraints, modules, leaves, found);
+    if (found.empty())
+        return;
+
+    printf("\n %-10s %12s %12s %12s\n",
+           "feasible", "checked", "conflicts", "slack");
+    for (int k = 0; k < CONS_KINDS; k++)
+    {
+        int failed = 0;
+        long tightest = LONG_MAX;
+        for (int i = 0; i < found.size(); i++)
+        {
+            if (found[i].kind != k)
+                continue;
+            failed += found[i].slack < 0;
+            tightest = min(tightest, found[i].slack);
+        }
+        int checked = count_constraints(k);
+        if (checked == 0)
+            continue;
+        if (tightest == LONG_MAX)
+            printf(" %-10s %12d %12d %12s\n", cons_kind_names[k],
+                   checked, failed, "-");
+        else
+            printf(" %-10s %12d %12d %12ld\n", cons_kind_names[k],
+                   checked, failed, tightest);
+    }
+
+    vector<vector<int> > drop(CONS_KINDS);
+    for (int i = 0; i < found.size(); i++)
+    {
+        ConstraintSlack& s = found[i];
+        if (s.slack >= 0)
+            continue;
+        if (s.index == NIL)
+            printf("  %s: %s, slack %ld", cons_kind_names[s.kind], s.why, s.slack);
+        else
+            printf("  %s %d: %s, slack %ld", cons_kind_names[s.kind],
+                   s.index + 1, s.why, s.slack);
+        bool relax = feasibility_mode == FEASIBILITY_RELAX && s.index != NIL;
+        if ((s.dangling && feasibility_mode != FEASIBILITY_ABORT) ||
+            (relax && s.relaxed == NIL))
+        {
+            drop[s.kind].push_back(s.index);
+            printf(", dropped");
+        }
+        else if (relax)
+        {
+            if (s.kind == CONS_MAX_SEP)
+                constraints.max_sep[s.index].dis = s.relaxed;
+            else if (s.kind == CONS_RANGE)
+                constraints.range[s.index].range = s.relaxed;
+            printf(", relaxed to %ld", s.relaxed);
+        }
+        printf("\n");
+    }
+    if (conflicts > 0 && feasibility_mode == FEASIBILITY_ABORT)
+        error("%s: constraints that can never be met", filename);
+
+    // the drops, last first so the indices still hold
+    for (int k = 0; k < CONS_KINDS; k++)
     {
-        // if candidate generation failed, perturb again.
-        perturbation();
+        vector<int>& d = drop[k];
+        sort(d.rbegin(), d.rend());
+        for (int j = 0; j < d.size(); j++)
+        {
+            if (k == CONS_MAX_SEP)
+                constraints.max_sep.erase(constraints.max_sep.begin() + d[j]);
+            else if (k == CONS_RANGE)
+                constraints.range.erase(constraints.range.begin() + d[j]);
+            else if (k == CONS_CLTO)
+                constraints.clto_boundary.erase(constraints.clto_boundary.begin() + d[j]);
+            else if (k == CONS_PROXIMITY)
+                constraints.proximity.clear();
+            else if (k == CONS_BOUNDARY)
+                constraints.boundary.erase(constraints.boundary.begin() + d[j]);
+            else
+                constraints.fixed_boundary.erase(constraints.fixed_boundary.begin() + d[j]);
+        }
     }
 }
 
 //********** Checks Constraints **********//
+bool full_check = false;
+
 bool QBtree::constraintChecking()
 {
+    PROFILE_PHASE(PROF_REPAIR);
+    if (!full_check)
+    {
+        // only the constraints on modules whose trees changed since they held;
+        // one that holds has nothing to repair, so the rest go as before
+        check_count++;
+        mark_moved_constraints(false);
+        double start = wall_seconds();
+        measure_max_sep();
+        repair_stats[CONS_MAX_SEP].seconds += wall_seconds() - start;
+        int stopped = NIL;
+        for (int c = 0; c < cons_refs.size(); c++)
+        {
+            if (cons_refs[c].kind == stopped)
+                continue;
+            if (cons_clean[c])
+            {
+                repair_stats[cons_refs[c].kind].skipped++;
+                continue;
+            }
+            int status = check_constraint(cons_refs[c]);
+            if (status == CONS_FAILED)
+                return false;
+            if (status == CONS_STOP)
+                stopped = cons_refs[c].kind;
+            if (status != CONS_OK)
+                mark_moved_constraints(true);
+            else
+                hold_constraint(c);
+        }
+        return true;
+    }
+
     if (!constraints.max_sep.empty())
         // check MAXIMUM SEPERATION CONSTRAINT.
     {
+        double start = wall_seconds();
+        measure_max_sep();
+        repair_stats[CONS_MAX_SEP].seconds += wall_seconds() - start;
         if (!maximum_seperation())
             return false;
         //showQBTree();
@@ -1047,61 +1303,191 @@ bool QBtree::constraintChecking()
     return true;
 }
 
-//********** Fixed Boundary Constraint Handling **********//
-bool QBtree::fixed_boundary()
+//********** Index of the Constraints on each Module **********//
+// The constraints are listed in the order constraintChecking() takes them.
+// A module's place depends on its own tree only, so a constraint that held
+// still holds while the trees of its modules have the stamps they had then.
+void QBtree::index_constraints()
 {
-    int mod, index, x, y, rx, ry, left, right, top, bottom;
+    cons_refs.clear();
+    cons_mods.clear();
+    mod_cons.assign(modules.size(), vector<int>());
+    vector<int> mods(1);
+
+    for (int i = 0; i < constraints.max_sep.size(); i++)
+    {
+        vector<int> pair;
+        pair.push_back(constraints.max_sep[i].mod1);
+        pair.push_back(constraints.max_sep[i].mod2);
+        add_constraint(CONS_MAX_SEP, i, pair);
+    }
+    for (int i = 0; i < constraints.range.size(); i++)
+    {
+        mods[0] = constraints.range[i].mod;
+        add_constraint(CONS_RANGE, i, mods);
+    }
+    for (int i = 0; i < constraints.clto_boundary.size(); i++)
+    {
+        mods[0] = constraints.clto_boundary[i].mod;
+        add_constraint(CONS_CLTO, i, mods);
+    }
+    if (!constraints.proximity.empty())
+        add_constraint(CONS_PROXIMITY, 0, constraints.proximity);
     for (int i = 0; i < constraints.boundary.size(); i++)
     {
-        mod = constraints.boundary[i];
-        index = find_leaf_with_module(mod);
-        QBTreeNode* qbnode = &qbnodes[index];
-        // determine the boundary of module.
-        x = modules_info[mod].x;
-        y = modules_info[mod].y;
-        rx = modules_info[mod].rx;
-        ry = modules_info[mod].ry;
-        left = x > rx ? rx : x;
-        right = x > rx ? x : rx;
-        top = y > ry ? y : ry;
-        bottom = y > ry ? ry : y;
-        if (left != qbnode->boundRect.left && right != qbnode->boundRect.right &&
-            top != qbnode->boundRect.top && bottom != qbnode->boundRect.bottom)
+        mods[0] = constraints.boundary[i];
+        if (!mod_pinned[mods[0]])
+            add_constraint(CONS_BOUNDARY, i, mods);
+    }
+    for (int i = 0; i < constraints.fixed_boundary.size(); i++)
+    {
+        mods[0] = constraints.fixed_boundary[i].mod;
+        if (!mod_pinned[mods[0]])
+            add_constraint(CONS_FIXED_BOUNDARY, i, mods);
+    }
+
+    cons_held.assign(cons_refs.size(), vector<long>());
+    cons_clean.assign(cons_refs.size(), false);
+    leaf_stamp.assign(qbnodes.size(), 0);
+    mod_stamp.assign(modules.size(), 0);
+    mod_leaf.assign(modules.size(), NIL);
+    mod_repaired.assign(modules.size(), 0);
+    check_count = 0;
+}
+
+void QBtree::add_constraint(int kind, int index, const vector<int>& mods)
+{
+    ConsRef c;
+    c.kind = kind;
+    c.index = index;
+    for (int i = 0; i < mods.size(); i++)
+        mod_cons[mods[i]].push_back(cons_refs.size());
+    cons_refs.push_back(c);
+    cons_mods.push_back(mods);
+}
+
+// Follows the trees that changed to their modules and re-tests the
+// constraints on those. A repair edits trees without packing them, so what
+// it moved is checked again in the same pass, on the old places, and is not
+// known to hold until the next check.
+void QBtree::mark_moved_constraints(bool repair)
+{
+    for (int i = 0; i < qbnodes.size(); i++)
+    {
+        B_Tree* btree = qbnodes[i].btree;
+        long stamp = btree == nullptr ? 0 : btree->stamp;
+        if (stamp == leaf_stamp[i])
+            continue;
+        leaf_stamp[i] = stamp;
+        if (btree == nullptr)
+            continue;
+        vector<Node*> nodes = btree->allnodes();
+        for (int j = 0; j < nodes.size(); j++)
         {
-            int j;
-            for (j = 0; j < qbnode->btree->allnodes().size(); j++)
+            // an island's anchor brings its members along
+            int island = mod_island.empty() ? NIL : mod_island[nodes[j]->id];
+            int members = island == NIL ? 1 : islands[island].members.size();
+            for (int n = 0; n < members; n++)
             {
-                x = modules_info[qbnode->btree->allnodes()[j]->id].x;
-                y = modules_info[qbnode->btree->allnodes()[j]->id].y;
-                rx = modules_info[qbnode->btree->allnodes()[j]->id].rx;
-                ry = modules_info[qbnode->btree->allnodes()[j]->id].ry;
-                left = x > rx ? rx : x;
-                right = x > rx ? x : rx;
-                top = y > ry ? y : ry;
-                bottom = y > ry ? ry : y;
-                if (left == qbnode->boundRect.left || right == qbnode->boundRect.right ||
-                    top == qbnode->boundRect.top || bottom == qbnode->boundRect.bottom)
+                int mod = island == NIL ? nodes[j]->id : islands[island].members[n];
+                mod_leaf[mod] = i;
+                mod_stamp[mod] = stamp;
+                if (repair)
+                    mod_repaired[mod] = check_count;
+                for (int k = 0; k < mod_cons[mod].size(); k++)
                 {
-                    //SUCCESS CANDIDATE GENERATION
-                    qbnode->btree->swap_node_by_id(mod, qbnode->btree->allnodes()[j]->id);
-
-                    break;
+                    int c = mod_cons[mod][k];
+                    cons_clean[c] = !cons_held[c].empty();
+                    for (int m = 0; cons_clean[c] && m < cons_mods[c].size(); m++)
+                        cons_clean[c] = cons_held[c][m] == mod_stamp[cons_mods[c][m]];
                 }
             }
-            if (j == qbnode->btree->allnodes().size())
-            {
-                //FAILED CANDIDATE GENERATION
-                cout << "NOT SATISFIED" << endl;
-                return false;
-            }
         }
     }
+}
+
+// Constraint c held on the trees as they were packed.
+void QBtree::hold_constraint(int c)
+{
+    const vector<int>& mods = cons_mods[c];
+    for (int m = 0; m < mods.size(); m++)
+        if (mod_repaired[mods[m]] == check_count)
+            return;
+    cons_held[c].resize(mods.size());
+    for (int m = 0; m < mods.size(); m++)
+        cons_held[c][m] = mod_stamp[mods[m]];
+    cons_clean[c] = true;
+}
+
+int QBtree::check_constraint(const ConsRef& c)
+{
+    int status = CONS_OK;
+    RepairStats& stats = repair_stats[c.kind];
+    double start = wall_seconds();
+    long edits = B_Tree::last_stamp();
+    switch (c.kind)
+    {
+    case CONS_MAX_SEP:
+        status = check_max_sep(c.index);
+        break;
+    case CONS_RANGE:
+        status = check_range(c.index);
+        break;
+    case CONS_CLTO:
+        status = check_clto(c.index);
+        break;
+    case CONS_PROXIMITY:
+        status = check_proximity();
+        break;
+    case CONS_BOUNDARY:
+        status = check_boundary(constraints.boundary[c.index]);
+        break;
+    case CONS_FIXED_BOUNDARY:
+        status = check_boundary(constraints.fixed_boundary[c.index].mod);
+        break;
+    }
+    stats.checks++;
+    if (status != CONS_OK)
+    {
+        // a repair that changed no tree did not happen
+        stats.violations++;
+        if (B_Tree::last_stamp() != edits)
+            stats.repairs++;
+        else
+            stats.failures++;
+    }
+    stats.seconds += wall_seconds() - start;
+    return status;
+}
+
+//********** Fixed Boundary Constraint Handling **********//
+bool QBtree::fixed_boundary()
+{
+    ConsRef c = { CONS_FIXED_BOUNDARY, 0 };
+    for (c.index = 0; c.index < constraints.fixed_boundary.size(); c.index++)
+    {
+        if (mod_pinned[constraints.fixed_boundary[c.index].mod])
+            continue;
+        if (check_constraint(c) == CONS_FAILED)
+            return false;
+    }
     return true;
 }
 
 //********** Proximity Constraint Handling **********//
 bool QBtree::proximity()
 {
+    if (group_held)
+        return true;
+    ConsRef c = { CONS_PROXIMITY, 0 };
+    check_constraint(c);
+    return true;
+}
+
+int QBtree::check_proximity()
+{
+    if (group_held)
+        return CONS_OK;
     int x, y, rx, ry, left, right, top, bottom, min_x, min_y, max_rx, max_ry;
     double dx, dy, drx, dry, max_d1, max_d2, distance;
     int standard_mod;
@@ -1154,29 +1540,217 @@ bool QBtree::proximity()
                 //cout<<"Proximity "<<j<<" : candidate generation is succeed."<<endl;
             }
         }
+        return CONS_VIOLATED;
     }
     else
     {
         //cout<<"proximity constraints are satisfied."<<endl;
     }
 
-    return true;
+    return CONS_OK;
+}
+
+//********** Proximity Group Kept As One Subtree **********//
+bool cluster_proximity = false;
+
+// The group's tree nodes, one per symmetry island. gather_proximity hands
+// them to the tree that is to hold them; while one tree holds them the
+// proximity check and its repair are off.
+void QBtree::cluster_modules()
+{
+    group_mods.clear();
+    mod_grouped.assign(modules.size(), 0);
+    group_held = false;
+    group_tree = nullptr;
+    if (!cluster_proximity)
+        return;
+    for (int i = 0; i < constraints.proximity.size(); i++)
+    {
+        int mod = anchor_of(constraints.proximity[i]);
+        if (mod != NIL && !mod_grouped[mod])
+        {
+            mod_grouped[mod] = 1;
+            group_mods.push_back(mod);
+        }
+    }
+    if (group_mods.size() < 2)
+    {
+        group_mods.clear();
+        mod_grouped.assign(modules.size(), 0);
+    }
+    for (int t = 0; t < b_trees.size(); t++)
+        b_trees[t]->group.clear();
+}
+
+// Members that moves took to other trees go back to the tree holding most
+// of the group, which gathers them into its subtree when it packs. Only
+// while its leaf has room for them: an over-full leaf stays over-full, as
+// no move may then take a member out. Until then the proximity check and
+// its repair stand in.
+void QBtree::gather_proximity()
+{
+    group_held = false;
+    group_tree = nullptr;
+    if (group_mods.empty())
+        return;
+    for (int t = 0; t < b_trees.size(); t++)
+        b_trees[t]->group.clear();
+    // area of a tree node: a module, or the island it anchors
+    auto node_area = [this](int id) {
+        int k = mod_island[id];
+        return k == NIL ? double(modules[id].area) :
+                          double(islands[k].width) * islands[k].height;
+    };
+    vector<B_Tree*> tree(modules.size(), nullptr);
+    vector<int> count(b_trees.size(), 0);
+    vector<double> area(b_trees.size(), 0);
+    for (int t = 0; t < b_trees.size(); t++)
+    {
+        auto nodes = b_trees[t]->allnodes();
+        for (int j = 0; j < nodes.size(); j++)
+        {
+            int id = nodes[j]->id;
+            area[t] += node_area(id);
+            if (mod_grouped[id])
+            {
+                tree[id] = b_trees[t];
+                count[t]++;
+            }
+        }
+    }
+    int home = max_element(count.begin(), count.end()) - count.begin();
+    B_Tree* to = b_trees[home];
+    const RECT& leaf = find_qbnode_with_btree(to)->boundRect;
+    // as last packed, the tree stayed in its leaf
+    if (to->getWidth() > leaf.right - leaf.left || to->getHeight() > leaf.top - leaf.bottom)
+        return;
+    group_held = true;
+    group_tree = to;
+    to->group = group_mods;
+    if (count[home] == group_mods.size())
+        return;
+    double need = area[home];
+    for (int i = 0; i < group_mods.size(); i++)
+    {
+        int id = group_mods[i];
+        if (tree[id] != nullptr && tree[id] != to)
+            need += node_area(id);
+    }
+    if (need > double(leaf.right - leaf.left) * (leaf.top - leaf.bottom))
+    {
+        group_held = false;
+        group_tree = nullptr;
+        to->group.clear();
+        return;
+    }
+    for (int i = 0; i < group_mods.size(); i++)
+    {
+        B_Tree* from = tree[group_mods[i]];
+        if (from == nullptr || from == to)
+            continue;
+        Op1(find_qbnode_with_btree(from) - &qbnodes[0],
+            find_qbnode_with_btree(to) - &qbnodes[0], group_mods[i]);
+    }
+}
+
+// Lifted into one subtree the group can overflow the leaf its modules fitted
+// in before. The tree then goes back as it was and packs without gathering.
+void QBtree::pack_group(int leaf)
+{
+    B_Tree* t = qbnodes[leaf].btree;
+    const RECT& r = qbnodes[leaf].boundRect;
+    vector<Node>* before = new vector<Node>();
+    t->copyTree(*before);
+    t->packing();
+    if (t->getWidth() <= r.right - r.left && t->getHeight() <= r.top - r.bottom)
+    {
+        delete before;
+        return;
+    }
+    t->adoptTree(before);
+    t->group.clear();
+    t->packing();
+    group_held = false;
+    group_tree = nullptr;
 }
 
 //********** Boundary Constraint Handling **********//
+bool pin_boundary = false;
+
+// The trees are built before the constraints are read, so they are handed
+// the list here; later ones get it from initBTree. A module in a symmetry
+// island is not a tree node of its own and stays with check_boundary, as
+// does one with a minimum separation, which packs it clear of the chains.
+void QBtree::pin_modules()
+{
+    pinned_mods.clear();
+    mod_pinned.assign(modules.size(), 0);
+    if (!pin_boundary)
+        return;
+    vector<char> sep(modules.size(), 0);
+    for (int i = 0; i < constraints.min_sep.size(); i++)
+        if (constraints.min_sep[i].mod != NIL)
+            sep[constraints.min_sep[i].mod] = 1;
+    vector<int> mods = constraints.boundary;
+    for (int i = 0; i < constraints.fixed_boundary.size(); i++)
+        mods.push_back(constraints.fixed_boundary[i].mod);
+    for (int i = 0; i < mods.size(); i++)
+        if (mods[i] != NIL && anchor_of(mods[i]) == mods[i] && !mod_grouped[mods[i]] &&
+            !sep[mods[i]] &&
+            find(pinned_mods.begin(), pinned_mods.end(), mods[i]) == pinned_mods.end())
+            pinned_mods.push_back(mods[i]);
+    for (int i = 0; i < pinned_mods.size(); i++)
+        mod_pinned[pinned_mods[i]] = 1;
+    for (int t = 0; t < b_trees.size(); t++)
+    {
+        b_trees[t]->pinned = pinned_mods;
+        b_trees[t]->touch();
+    }
+}
+
 bool QBtree::boundary()
 {
-    int mod, index, x, y, rx, ry, left, right, top, bottom;
-    for (int i = 0; i < constraints.boundary.size(); i++)
+    ConsRef c = { CONS_BOUNDARY, 0 };
+    for (c.index = 0; c.index < constraints.boundary.size(); c.index++)
+    {
+        if (mod_pinned[constraints.boundary[c.index]])
+            continue;
+        if (check_constraint(c) == CONS_FAILED)
+            return false;
+    }
+    return true;
+}
+
+int QBtree::check_boundary(int mod)
+{
+    int index, x, y, rx, ry, left, right, top, bottom;
+    int anchor = anchor_of(mod);
+    index = find_leaf_with_module(mod);
+    QBTreeNode* qbnode = &qbnodes[index];
+    x = modules_info[mod].x;
+    y = modules_info[mod].y;
+    rx = modules_info[mod].rx;
+    ry = modules_info[mod].ry;
+    //determine the boundary of module
+    left = x > rx ? rx : x;
+    right = x > rx ? x : rx;
+    top = y > ry ? y : ry;
+    bottom = y > ry ? ry : y;
+    if (left == qbnode->boundRect.left || right == qbnode->boundRect.right ||
+        top == qbnode->boundRect.top || bottom == qbnode->boundRect.bottom)
+    {
+        return CONS_OK;
+    }
+
+    vector<Node*> nodes = qbnode->btree->allnodes();
+    for (int j = 0; j < nodes.size(); j++)
     {
-        mod = constraints.boundary[i];
-        index = find_leaf_with_module(mod);
-        QBTreeNode* qbnode = &qbnodes[index];
-        x = modules_info[mod].x;
-        y = modules_info[mod].y;
-        rx = modules_info[mod].rx;
-        ry = modules_info[mod].ry;
-        //determine the boundary of module
+        if (anchor != mod && nodes[j]->id == anchor)
+            continue;
+        x = modules_info[nodes[j]->id].x;
+        y = modules_info[nodes[j]->id].y;
+        rx = modules_info[nodes[j]->id].rx;
+        ry = modules_info[nodes[j]->id].ry;
         left = x > rx ? rx : x;
         right = x > rx ? x : rx;
         top = y > ry ? y : ry;
@@ -1184,246 +1758,250 @@ bool QBtree::boundary()
         if (left == qbnode->boundRect.left || right == qbnode->boundRect.right ||
             top == qbnode->boundRect.top || bottom == qbnode->boundRect.bottom)
         {
-        }
-        else
-        {
-            int j;
-            for (j = 0; j < qbnode->btree->allnodes().size(); j++)
-            {
-                x = modules_info[qbnode->btree->allnodes()[j]->id].x;
-                y = modules_info[qbnode->btree->allnodes()[j]->id].y;
-                rx = modules_info[qbnode->btree->allnodes()[j]->id].rx;
-                ry = modules_info[qbnode->btree->allnodes()[j]->id].ry;
-                left = x > rx ? rx : x;
-                right = x > rx ? x : rx;
-                top = y > ry ? y : ry;
-                bottom = y > ry ? ry : y;
-                if (left == qbnode->boundRect.left || right == qbnode->boundRect.right ||
-                    top == qbnode->boundRect.top || bottom == qbnode->boundRect.bottom)
-                {
-                    //SUCCESS CANDIDATE GENERATION
-                    qbnode->btree->swap_node_by_id(mod, qbnode->btree->allnodes()[j]->id);
-                    break;
-                }
-            }
-            if (j == qbnode->btree->allnodes().size())
-            {
-                //FAILED CANDIDATE GENERATION
-                return false;
-            }
+            //SUCCESS CANDIDATE GENERATION
+            qbnode->btree->swap_node_by_id(anchor, nodes[j]->id);
+            return CONS_VIOLATED;
         }
     }
-    return true;
+    //FAILED CANDIDATE GENERATION
+    return CONS_FAILED;
 }
 
 //********** Close_to_Boundary Constraint Handling **********//
 bool QBtree::close_to_boundary()
 {
-    int mod, dis, b, x, y, rx, ry, l, r, t, b_index, cn;
-    long w, h;
-    for (int i = 0; i < constraints.clto_boundary.size(); i++)
+    ConsRef c = { CONS_CLTO, 0 };
+    for (c.index = 0; c.index < constraints.clto_boundary.size(); c.index++)
     {
-        cn = 0;
-        mod = constraints.clto_boundary[i].mod;
-        dis = constraints.clto_boundary[i].dis;
-        b_index = find_btree(mod);
-        x = modules_info[mod].x;
-        y = modules_info[mod].y;
-        rx = modules_info[mod].rx;
-        ry = modules_info[mod].ry;
-        //determine the boudnary of module
-        l = x > rx ? rx : x;
-        r = x > rx ? x : rx;
-        t = y > ry ? y : ry;
-        b = y > ry ? ry : y;
-        QBTreeNode* qnode = find_qbnode_with_btree(b_trees[b_index]);
-        w = qnode->boundRect.right - qnode->boundRect.left;
-        h = qnode->boundRect.top - qnode->boundRect.bottom;
-
-        if (w > (dis * 2) || h > (dis * 2))
-        {
-            //IF CONSTRIANT IS NOT SATISFIED
-            if (b < (qnode->boundRect.top - dis) || l < (qnode->boundRect.right - dis) || r >(qnode->boundRect.left + dis) || t >(qnode->boundRect.bottom + dis))
+        // one swap per check
+        if (check_constraint(c) == CONS_STOP)
+            return true;
+    }
+    return true;
+}
+
+int QBtree::check_clto(int i)
+{
+    int mod, dis, b, x, y, rx, ry, l, r, t, b_index;
+    long w, h;
+    mod = constraints.clto_boundary[i].mod;
+    dis = constraints.clto_boundary[i].dis;
+    int anchor = anchor_of(mod);
+    b_index = find_btree(mod);
+    x = modules_info[mod].x;
+    y = modules_info[mod].y;
+    rx = modules_info[mod].rx;
+    ry = modules_info[mod].ry;
+    //determine the boudnary of module
+    l = x > rx ? rx : x;
+    r = x > rx ? x : rx;
+    t = y > ry ? y : ry;
+    b = y > ry ? ry : y;
+    QBTreeNode* qnode = find_qbnode_with_btree(b_trees[b_index]);
+    w = qnode->boundRect.right - qnode->boundRect.left;
+    h = qnode->boundRect.top - qnode->boundRect.bottom;
+
+    if (w > (dis * 2) || h > (dis * 2))
+    {
+        //IF CONSTRIANT IS NOT SATISFIED
+        if (b < (qnode->boundRect.top - dis) || l < (qnode->boundRect.right - dis) || r >(qnode->boundRect.left + dis) || t >(qnode->boundRect.bottom + dis))
+        {
+            auto nodes = qnode->btree->allnodes();
+            for (int i = 0; i < nodes.size(); i++)
             {
-                auto nodes = qnode->btree->allnodes();
-                for (int i = 0; i < nodes.size(); i++)
+                if (anchor != mod && nodes[i]->id == anchor)
+                    continue;
+                x = modules_info[nodes[i]->id].x;
+                y = modules_info[nodes[i]->id].y;
+                rx = modules_info[nodes[i]->id].rx;
+                ry = modules_info[nodes[i]->id].ry;
+                l = x > rx ? rx : x;
+                r = x > rx ? x : rx;
+                t = y > ry ? y : ry;
+                b = y > ry ? ry : y;
+
+                if (b > (qnode->boundRect.top - dis) || l > (qnode->boundRect.right - dis) || r < (qnode->boundRect.left + dis) || t < (qnode->boundRect.bottom + dis))
                 {
-                    x = modules_info[nodes[i]->id].x;
-                    y = modules_info[nodes[i]->id].y;
-                    rx = modules_info[nodes[i]->id].rx;
-                    ry = modules_info[nodes[i]->id].ry;
-                    l = x > rx ? rx : x;
-                    r = x > rx ? x : rx;
-                    t = y > ry ? y : ry;
-                    b = y > ry ? ry : y;
-
-                    if (b > (qnode->boundRect.top - dis) || l > (qnode->boundRect.right - dis) || r < (qnode->boundRect.left + dis) || t < (qnode->boundRect.bottom + dis))
-                    {
-                        qnode->btree->swap_node_by_id(nodes[i]->id, mod);
-                        //cout<<nodes[i]->id<<" : "<<mod<<endl;
-                        //cout<<"Close to boundary "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
-                        return true;
-                    }
+                    qnode->btree->swap_node_by_id(nodes[i]->id, anchor);
+                    //cout<<nodes[i]->id<<" : "<<mod<<endl;
+                    //cout<<"Close to boundary "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
+                    return CONS_STOP;
                 }
             }
-            else
-            {
-                //cout<<"Close to boundary "<<i+1<<" : "<<"is satisfied."<<endl;
-            }
+            return CONS_VIOLATED;
         }
         else
         {
-            //CANDIDATE GENERATION
-            for (int j = 0; j < qbnodes.size(); j++)
+            //cout<<"Close to boundary "<<i+1<<" : "<<"is satisfied."<<endl;
+        }
+    }
+    else
+    {
+        //CANDIDATE GENERATION, A QUAD LEAF WITH A B*-TREE TO JOIN
+        for (int l = 0; l < quad_leaves.size(); l++)
+        {
+            int j = quad_leaves[l];
+            if (qbnodes[j].btree == nullptr)
+                continue;
+            w = qbnodes[j].boundRect.right - qbnodes[j].boundRect.left;
+            h = qbnodes[j].boundRect.top - qbnodes[j].boundRect.bottom;
+            if (w > (dis * 2) || h > (dis * 2))
             {
-                w = qbnodes[j].boundRect.right - qbnodes[j].boundRect.left;
-                h = qbnodes[j].boundRect.top - qbnodes[j].boundRect.bottom;
-                if (w > (dis * 2) || h > (dis * 2))
-                {
-                    Op1(find_leaf_with_module(mod), j, mod);
-                    //cout<<"Close to boundary "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
-                    break;
-                }
+                Op1(find_leaf_with_module(mod), j, mod);
+                //cout<<"Close to boundary "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
+                break;
             }
         }
+        return CONS_VIOLATED;
     }
+    return CONS_OK;
 }
 
 //********** Range Constraint Handling **********//
 bool QBtree::range_cons()
 {
-    int mod, range, b_inx, x, y, rx, ry, left, right, top, bottom, cn;
-    for (int i = 0; i < constraints.range.size(); i++)
+    ConsRef c = { CONS_RANGE, 0 };
+    for (c.index = 0; c.index < constraints.range.size(); c.index++)
     {
-        //GET THE MODULE INFORMATION
-        mod = constraints.range[i].mod;
-        //GET THE RANGE VALUE
-        range = constraints.range[i].range;
-        //FIND B*-TREE WITH THE GIVEN MODULE
-        b_inx = find_btree(mod);
-        if (b_inx == NIL)
-        {
+        if (check_constraint(c) == CONS_FAILED)
             return false;
-        }
-        x = modules_info[mod].x;
-        y = modules_info[mod].y;
-        rx = modules_info[mod].rx;
-        ry = modules_info[mod].ry;
-        left = x > rx ? rx : x;
-        right = x > rx ? x : rx;
-        top = y > ry ? y : ry;
-        bottom = y > ry ? ry : y;
-        QBTreeNode* qnode = find_qbnode_with_btree(b_trees[b_inx]);
-        //CHECK BOUNDARY
-        if (strcmp(constraints.range[i].boundary, "TOP") == 0)
+    }
+    return true;
+}
+
+int QBtree::check_range(int i)
+{
+    int mod, range, b_inx, x, y, rx, ry, left, right, top, bottom, cn;
+    //GET THE MODULE INFORMATION
+    mod = constraints.range[i].mod;
+    //GET THE RANGE VALUE
+    range = constraints.range[i].range;
+    //FIND B*-TREE WITH THE GIVEN MODULE
+    b_inx = find_btree(mod);
+    if (b_inx == NIL)
+    {
+        return CONS_FAILED;
+    }
+    x = modules_info[mod].x;
+    y = modules_info[mod].y;
+    rx = modules_info[mod].rx;
+    ry = modules_info[mod].ry;
+    left = x > rx ? rx : x;
+    right = x > rx ? x : rx;
+    top = y > ry ? y : ry;
+    bottom = y > ry ? ry : y;
+    QBTreeNode* qnode = find_qbnode_with_btree(b_trees[b_inx]);
+    //CHECK BOUNDARY
+    if (constraints.range[i].side == RANGE_TOP)
+    {
+        cn = 0;
+        if ((qnode->boundRect.top - range) < top)
+            //VIOLATING TOP RANGE CONSTRAINT
         {
-            cn = 0;
-            if ((qnode->boundRect.top - range) < top)
-                //VIOLATING TOP RANGE CONSTRAINT
+            //CANDIDATE GENERATION
+            for (int t = 0; t < b_trees.size(); t++)
             {
-                //CANDIDATE GENERATION
-                for (int t = 0; t < b_trees.size(); t++)
-                {
-                    bool flag = false;
-                    auto nodes = b_trees[t]->allnodes();
-                    QBTreeNode* leaf = find_qbnode_with_btree(b_trees[t]);
+                bool flag = false;
+                auto nodes = b_trees[t]->allnodes();
+                QBTreeNode* leaf = find_qbnode_with_btree(b_trees[t]);
 
-                    if (leaf == qnode)
-                        continue;
-                    for (int j = 0; j < nodes.size(); j++)
+                if (leaf == qnode)
+                    continue;
+                for (int j = 0; j < nodes.size(); j++)
+                {
+                    x = modules_info[nodes[j]->id].x;
+                    y = modules_info[nodes[j]->id].y;
+                    rx = modules_info[nodes[j]->id].rx;
+                    ry = modules_info[nodes[j]->id].ry;
+                    left = x > rx ? rx : x;
+                    right = x > rx ? x : rx;
+                    top = y > ry ? y : ry;
+                    bottom = y > ry ? ry : y;
+
+                    // cout<<top<< " : "<<leaf->boundRect.top<<endl;
+
+                    if (leaf->boundRect.top - range > top)
+                        // find other module in other b*-tree satisfied range constraint.
                     {
-                        x = modules_info[nodes[j]->id].x;
-                        y = modules_info[nodes[j]->id].y;
-                        rx = modules_info[nodes[j]->id].rx;
-                        ry = modules_info[nodes[j]->id].ry;
-                        left = x > rx ? rx : x;
-                        right = x > rx ? x : rx;
-                        top = y > ry ? y : ry;
-                        bottom = y > ry ? ry : y;
-
-                        // cout<<top<< " : "<<leaf->boundRect.top<<endl;
-
-                        if (leaf->boundRect.top - range > top)
-                            // find other module in other b*-tree satisfied range constraint.
-                        {
-                            cn++;
-                            Op2(nodes[j]->id, mod);
-                            //cout<<"Range "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
-                            flag = true;
-                            break;
-                        }
-                    }
-
-                    if (flag)
+                        cn++;
+                        Op2(nodes[j]->id, mod);
+                        //cout<<"Range "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
+                        flag = true;
                         break;
+                    }
                 }
-                if (cn == 0)
-                {
-                    // cout<<"Range "<<i+1<<" : "<<"candidate generation is failed."<<endl;
-                    return false;
-                }
+
+                if (flag)
+                    break;
             }
-            else
+            if (cn == 0)
             {
-                // cout<<"Range "<<i+1<<" : "<<"is satisfied."<<endl;
+                // cout<<"Range "<<i+1<<" : "<<"candidate generation is failed."<<endl;
+                return CONS_FAILED;
             }
+            return CONS_VIOLATED;
         }
+        else
+        {
+            // cout<<"Range "<<i+1<<" : "<<"is satisfied."<<endl;
+        }
+    }
 
-        else if (strcmp(constraints.range[i].boundary, "BOTTOM") == 0)
+    else if (constraints.range[i].side == RANGE_BOTTOM)
+    {
+        cn = 0;
+        if ((qnode->boundRect.bottom + range) > bottom)
+            //VIOLATING BOTTOM RANGE CONSTRAINT
         {
-            cn = 0;
-            if ((qnode->boundRect.bottom + range) > bottom)
-                //VIOLATING BOTTOM RANGE CONSTRAINT
+            //CANDIDATE GENERATION
+            for (int t = 0; t < b_trees.size(); t++)
             {
-                //CANDIDATE GENERATION
-                for (int t = 0; t < b_trees.size(); t++)
-                {
-                    bool flag = false;
-                    auto nodes = b_trees[t]->allnodes();
-                    QBTreeNode* leaf = find_qbnode_with_btree(b_trees[t]);
+                bool flag = false;
+                auto nodes = b_trees[t]->allnodes();
+                QBTreeNode* leaf = find_qbnode_with_btree(b_trees[t]);
 
-                    if (leaf == qnode)
-                        continue;
-                    for (int j = 0; j < nodes.size(); j++)
+                if (leaf == qnode)
+                    continue;
+                for (int j = 0; j < nodes.size(); j++)
+                {
+                    x = modules_info[nodes[j]->id].x;
+                    y = modules_info[nodes[j]->id].y;
+                    rx = modules_info[nodes[j]->id].rx;
+                    ry = modules_info[nodes[j]->id].ry;
+                    left = x > rx ? rx : x;
+                    right = x > rx ? x : rx;
+                    top = y > ry ? y : ry;
+                    bottom = y > ry ? ry : y;
+
+                    // cout<<top<< " : "<<leaf->boundRect.top<<endl;
+
+                    if (leaf->boundRect.bottom + range < bottom)
+                        // find other module in other b*-tree satisfied range constraint.
                     {
-                        x = modules_info[nodes[j]->id].x;
-                        y = modules_info[nodes[j]->id].y;
-                        rx = modules_info[nodes[j]->id].rx;
-                        ry = modules_info[nodes[j]->id].ry;
-                        left = x > rx ? rx : x;
-                        right = x > rx ? x : rx;
-                        top = y > ry ? y : ry;
-                        bottom = y > ry ? ry : y;
-
-                        // cout<<top<< " : "<<leaf->boundRect.top<<endl;
-
-                        if (leaf->boundRect.bottom + range < bottom)
-                            // find other module in other b*-tree satisfied range constraint.
-                        {
-                            cn++;
-                            Op2(nodes[j]->id, mod);
-                            // cout<<"Range "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
-                            flag = true;
-                            break;
-                        }
-                    }
-
-                    if (flag)
+                        cn++;
+                        Op2(nodes[j]->id, mod);
+                        // cout<<"Range "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
+                        flag = true;
                         break;
+                    }
                 }
-                if (cn == 0)
-                {
-                    // cout<<"Range "<<i+1<<" : "<<"candidate generation is failed."<<endl;
-                    return false;
-                }
+
+                if (flag)
+                    break;
             }
-            else
+            if (cn == 0)
             {
-                // cout<<"Range "<<i+1<<" : "<<"is satisfied."<<endl;
+                // cout<<"Range "<<i+1<<" : "<<"candidate generation is failed."<<endl;
+                return CONS_FAILED;
             }
+            return CONS_VIOLATED;
+        }
+        else
+        {
+            // cout<<"Range "<<i+1<<" : "<<"is satisfied."<<endl;
         }
     }
-    return true;
+    return CONS_OK;
 }
 
 //********** Minimum_Separation Constraint Handling **********//
@@ -1448,30 +2026,14 @@ bool QBtree::minimum_seperation()
         cy = top - (top - bottom) / 2;
         ml = mr = mt = mb = INT_MIN;
 
+        // another module within dis of it
         cn = 0;
-        mod = NIL;
-        for (int j = 0; j < modules_info.size(); j++)
+        RECT region = { left - dis + 1, right + dis - 1, bottom - dis + 1, top + dis - 1 };
+        index_placement();
+        placed_grid.query(region, grid_found);
+        for (int j = 0; j < grid_found.size(); j++)
         {
-            if (constraints.min_sep[i].mod == j)
-                continue;
-            x = modules_info[j].x;
-            y = modules_info[j].y;
-            rx = modules_info[j].rx;
-            ry = modules_info[j].ry;
-
-            l = x > rx ? rx : x;
-            r = x > rx ? x : rx;
-            t = y > ry ? y : ry;
-            b = y > ry ? ry : y;
-
-            x = r - (r - l) / 2;
-            y = t - (t - b) / 2;
-
-            //d = sqrt(pow((cx - x),2) + pow((cy - y),2)); 
-
-            if (r + dis > left || l - dis < right || b - dis < top || t + dis > bottom)
-                //if(d < dis)
-                // if this module is abut with constraint module by a distance (distance < costraint distance)
+            if (grid_found[j] != constraints.min_sep[i].mod)
             {
                 cn++;
                 break;
@@ -1510,70 +2072,64 @@ bool QBtree::minimum_seperation()
 
 bool QBtree::maximum_seperation()
 {
-    int x1, y1, x2, y2, mid1, mid2, x, y, rx, ry, dis, left, right, top, bottom, dis_min;
-    long d;
-    for (int i = 0; i < 1; i++)
+    ConsRef c = { CONS_MAX_SEP, 0 };
+    for (c.index = 0; c.index < constraints.max_sep.size(); c.index++)
     {
-        //GET MODULE 1 AND 2
-        mid1 = constraints.max_sep[i].mod1;
-        mid2 = constraints.max_sep[i].mod2;
-
-        //GET MODULE INFORMATION OF MODULE 1
-        x = modules_info[mid1].x;
-        y = modules_info[mid1].y;
-        rx = modules_info[mid1].rx;
-        ry = modules_info[mid1].ry;
-        dis = constraints.max_sep[i].dis;
-
-        //DETERMINE BOUNDARY OF MODULE 1
-        left = x > rx ? rx : x;
-        right = x > rx ? x : rx;
-        top = y > ry ? y : ry;
-        bottom = y > ry ? ry : y;
-        x1 = right - (right - left) / 2; //CENTER OF THE MODULE
-        y1 = top - (top - bottom) / 2;
+        if (check_constraint(c) == CONS_FAILED)
+            return false;
+    }
+    return true;
+}
 
-        //GET MODULE INFORMATION OF MODULE 2
-        x = modules_info[mid2].x;
-        y = modules_info[mid2].y;
-        rx = modules_info[mid2].rx;
-        ry = modules_info[mid2].ry;
+// The distances of all pairs in one pass: the centres are gathered first,
+// then compared in flat arrays the compiler can vectorize. A repair moves
+// modules in the trees only, so this holds until the next packing.
+void QBtree::measure_max_sep()
+{
+    int n = constraints.max_sep.size();
+    max_sep_pass.resize(5 * n);
+    double* __restrict ax = &max_sep_pass[0];
+    double* __restrict ay = ax + n;
+    double* __restrict bx = ay + n;
+    double* __restrict by = bx + n;
+    double* __restrict over = by + n;
+    for (int i = 0; i < n; i++)
+    {
+        const Module_Info& a = modules_info[constraints.max_sep[i].mod1];
+        const Module_Info& b = modules_info[constraints.max_sep[i].mod2];
+        // centres as the separation was always measured, rounded up
+        ax[i] = max(a.x, a.rx) - abs(a.rx - a.x) / 2;
+        ay[i] = max(a.y, a.ry) - abs(a.ry - a.y) / 2;
+        bx[i] = max(b.x, b.rx) - abs(b.rx - b.x) / 2;
+        by[i] = max(b.y, b.ry) - abs(b.ry - b.y) / 2;
+        // the distance was truncated: too far once it reaches dis + 1
+        double dis = constraints.max_sep[i].dis;
+        over[i] = dis < 0 ? -1 : (dis + 1) * (dis + 1);
+    }
+    for (int i = 0; i < n; i++)
+        over[i] = (ax[i] - bx[i]) * (ax[i] - bx[i]) + (ay[i] - by[i]) * (ay[i] - by[i]) - over[i];
+    max_sep_over = over;
+}
 
-        //DETERMINE BOUDNARY OF MODULE 2
-        left = x > rx ? rx : x;
-        right = x > rx ? x : rx;
-        top = y > ry ? y : ry;
-        bottom = y > ry ? ry : y;
-        x2 = right - (right - left) / 2;
-        y2 = top - (top - bottom) / 2;
-        // cout<<"x1 y1 and x2 y2"<<x1<<" "<<y1<<" "<<x2<<" "<<y2<<endl;
-        d = sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+int QBtree::check_max_sep(int i)
+{
+    //CHECK MAXIMUM SPEARATION, measured by measure_max_sep()
+    if (max_sep_over[i] < 0)
+        return CONS_OK;
+    // one island: only perturbing it brings them closer
+    if (anchor_of(constraints.max_sep[i].mod1) == anchor_of(constraints.max_sep[i].mod2))
+        return CONS_VIOLATED;
 
-        //CHECK MAXIMUM SPEARATION
-        if (d > dis)
-        {
-            //FAILED CANDIDATE GENERATION
-            if (!candidateGeneration(1, mid2, i))
-            {
-                //cout<<"Maximun Seperation "<<i+1<<" : "<<"candidate generation is failed."<<endl;
-                return false;
-            }
-            else
-            {
-                //cout<<"Maximun Seperation "<<i+1<<" : "<<"candidate generation is succeed."<<endl;
-            }
-        }
-        else
-        {
-            //cout<<"Maximun Seperation "<<i+1<<" : "<<"is satisfied."<<endl;
-        }
-    }
-    return true;
+    //FAILED CANDIDATE GENERATION
+    if (!candidateGeneration(1, constraints.max_sep[i].mod2, i))
+        return CONS_FAILED;
+    return CONS_VIOLATED;
 }
 
 //RETRIEVES B*-TREE WITH GIVEN MODULE
 int QBtree::find_btree(int mod)
 {
+    mod = anchor_of(mod);
     for (int j = 0; j < b_trees.size(); j++)
     {
         auto nodes = b_trees[j]->allnodes();
@@ -1612,15 +2168,18 @@ bool QBtree::candidateGeneration(int constraint, int mod_id, int index)
     bottom = top - (top - bottom) / 2 - dis;
     top = bottom + 2 * dis;
 
-    //GENERATE CANDIDATE
-    for (int i = 0; i < qbnodes.size(); i++)
+    //GENERATE CANDIDATE, AMONG THE EMPTY QUAD LEAVES IN THE REGION
+    RECT region = { left, right, bottom, top };
+    leaf_grid.query(region, grid_found);
+    for (int l = 0; l < grid_found.size(); l++)
     {
-        if (!qbnodes[i].isleaf())
+        int i = quad_leaves[grid_found[l]];
+        if (qbnodes[i].btree != nullptr)
             continue;
         //IF QUADLEAF OVERLAPS WITH THE MAXIMUM_SEPARATION REGION
         if (qbnodes[i].boundRect.left < right && qbnodes[i].boundRect.right > left && qbnodes[i].boundRect.top > bottom && qbnodes[i].boundRect.bottom < top)
         {
-            width = qbnodes[i].boundRect.right - qbnodes[i].boundRect.right;
+            width = qbnodes[i].boundRect.right - qbnodes[i].boundRect.left;
             height = qbnodes[i].boundRect.top - qbnodes[i].boundRect.bottom;
 
             //IF NODE BELONGS TO TOP LEFT;
@@ -1675,10 +2234,10 @@ bool QBtree::candidateGeneration(int constraint, int mod_id, int index)
             }
         }
     }
-    //FAILED CANDIDATE GENERATION
+    //NO EMPTY QUAD LEAF NEARBY: PACK MODULE 2 AGAINST MODULE 1
     if (dis_min == INT_MIN || c_index == NIL)
     {
-        return false;
+        return Op4(mod2, mod1);
     }
 
     int t = find_leaf_with_module(mod2);
@@ -1690,22 +2249,14 @@ bool QBtree::candidateGeneration(int constraint, int mod_id, int index)
 //RETRIEVES QBTREE NODE'S ID USING MODULE ID
 int QBtree::find_leaf_with_module(int mod_id)
 {
-    int b_index = NIL;
-    for (int i = 0; i < b_trees.size(); i++)
+    mod_id = anchor_of(mod_id);
+    for (int l = 0; l < quad_leaves.size(); l++)
     {
-        auto nodes = b_trees[i]->allnodes();
-        for (int j = 0; j < nodes.size(); j++)
-        {
-            if (nodes[j]->id == mod_id)
-            {
-                b_index = i;
-            }
-        }
-    }
-    for (int i = 0; i < qbnodes.size(); i++)
-    {
-        if (qbnodes[i].btree == b_trees[b_index])
-            return i;
+        B_Tree* btree = qbnodes[quad_leaves[l]].btree;
+        if (btree == nullptr)
+            continue;
+        if (btree->find_node_by_id(mod_id) != nullptr)
+            return quad_leaves[l];
     }
     return NIL;
 }
@@ -1715,6 +2266,7 @@ void QBtree::Op1(int index, int op_index, int mod_id)
 {
     if (index == op_index)
         return;
+    mod_id = anchor_of(mod_id);
     //cout<<"index : "<<index<<" : "<<op_index<<" , mod : "<<mod_id<<endl;
     QBTreeNode* qnode = &qbnodes[index];
     QBTreeNode* op_qnode = &qbnodes[op_index];
@@ -1740,6 +2292,8 @@ void QBtree::Op2(int op_mod_id, int mod_id)
 {
     int i, j;
     Node* p;
+    op_mod_id = anchor_of(op_mod_id);
+    mod_id = anchor_of(mod_id);
     if (b_trees.size() > 1)
     {
 
@@ -1764,6 +2318,7 @@ void QBtree::Op3(int index, int op_index, int mod_id)
 {
     // cout<<"Op3 : "<<mod_id<<" "<<index<<" "<<op_index<<endl;
     Node* node = nullptr;
+    mod_id = anchor_of(mod_id);
     int t = find_btree(mod_id);
     // cout<<"index : "<<index<< " op_index : "<<op_index<<" mod_id : "<<mod_id<<endl;
     QBTreeNode* qnode = &qbnodes[index];
@@ -1798,6 +2353,32 @@ void QBtree::Op3(int index, int op_index, int mod_id)
     b_trees.push_back(op_qnode->btree);
 }
 
+//OPERATION TO MAKE A NODE A CHILD OF ANOTHER ONE, WHICH IT IS PACKED AGAINST
+bool QBtree::Op4(int mod_id, int to_mod_id)
+{
+    mod_id = anchor_of(mod_id);
+    to_mod_id = anchor_of(to_mod_id);
+    if (mod_id == to_mod_id)
+        return false;
+    int t = find_btree(mod_id);
+    QBTreeNode* qnode = &qbnodes[find_leaf_with_module(mod_id)];
+    QBTreeNode* op_qnode = &qbnodes[find_leaf_with_module(to_mod_id)];
+    //delete node.
+    if (b_trees[t]->allnodes().size() == 1)
+    {
+        //delete btree
+        qnode->btree = nullptr;
+        SAFE_DELETE(b_trees[t]);
+        b_trees.erase(b_trees.begin() + t);
+    }
+    else
+    {
+        b_trees[t]->take_node(mod_id);
+    }
+    op_qnode->btree->insertNodeById(op_qnode->btree->find_node_by_id(to_mod_id), mod_id);
+    return true;
+}
+
 //MOVES NODE FROM ONE QUADTREE LEAF TO ANOTHER
 void QBtree::move_node_to_quad_leaf()
 {
@@ -1809,7 +2390,10 @@ void QBtree::move_node_to_quad_leaf()
 
     //delete from the first B-Tree
 
-    i = rand() % b_trees.size();
+    i = rand_int(b_trees.size());
+    int from = NIL;
+    if (trajectory.recording())
+        from = find_qbnode_with_btree(b_trees[i]) - &qbnodes[0];
     if (b_trees[i]->allnodes().size() == 1)
     {
         //find QB-tree leaf with btree.
@@ -1832,6 +2416,8 @@ void QBtree::move_node_to_quad_leaf()
     constructBTree(*qnode->btree, inds);
     //register root node
     b_trees.push_back(qnode->btree);
+    if (trajectory.recording())
+        trajectory.note(MOVE_TO_LEAF, mid, from, qnode - &qbnodes[0]);
 }
 
 //MOVE NODE FROM ONE B*-TREE TO ANOTHER B*-TREE
@@ -1843,10 +2429,13 @@ void QBtree::move_node_to_b()
         //generate 2 different indices in [0 until b_tress.size()]
         do
         {
-            i = rand() % b_trees.size();
-            j = rand() % b_trees.size();
+            i = rand_int(b_trees.size());
+            j = rand_int(b_trees.size());
         } while (i == j);
 
+        int from = NIL;
+        if (trajectory.recording())
+            from = find_qbnode_with_btree(b_trees[i]) - &qbnodes[0];
         //delete from the first B-Tree
         //if number of nodes of the first B-Tree is 0 then set Q-Node as leaf, remove the B-Tree from the b_trees.
         if (b_trees[i]->allnodes().size() == 1)
@@ -1866,6 +2455,9 @@ void QBtree::move_node_to_b()
         }
         // [3]. insert to the second B-Tree
         b_trees[j]->insertNodeById(b_trees[j]->find_node_random(), mid1);
+        if (trajectory.recording())
+            trajectory.note(MOVE_TO_TREE, mid1, from,
+                            find_qbnode_with_btree(b_trees[j]) - &qbnodes[0]);
     }
 }
 
@@ -1880,11 +2472,18 @@ void QBtree::swap_node()
         //generate 2 different indices in [0 until b_tress.size()]
         do
         {
-            i = rand() % b_trees.size();
-            j = rand() % b_trees.size();
+            i = rand_int(b_trees.size());
+            j = rand_int(b_trees.size());
         } while (i == j);
         mid1 = b_trees[i]->find_node_random()->id;
         mid2 = b_trees[j]->find_node_random()->id;
+        if (trajectory.recording())
+        {
+            int a = find_qbnode_with_btree(b_trees[i]) - &qbnodes[0];
+            int b = find_qbnode_with_btree(b_trees[j]) - &qbnodes[0];
+            trajectory.note(MOVE_SWAP, mid1, a, b);
+            trajectory.note(MOVE_SWAP, mid2, b, a);
+        }
         //swap_node
         Op2(mid1, mid2);
         //showQBTree();
@@ -1894,9 +2493,15 @@ void QBtree::swap_node()
 //QB-TREE PACKING
 void QBtree::packing()
 {
+    PROFILE_PHASE(PROF_PACKING);
     int i, j, t, r;
+    gather_proximity();
     modules_info.clear();
     modules_info.resize(modules.size());
+    placed_stale = true;
+    placed_leaf.assign(modules.size(), NIL);
+    packed_stamp.resize(qbnodes.size(), 0);
+    mod_moved.resize(modules.size(), 1);
 
     //place module.
     for (i = 0; i < qbnodes.size(); i++)
@@ -1904,11 +2509,23 @@ void QBtree::packing()
 
         if (qbnodes[i].btree == nullptr)
         {
+            packed_stamp[i] = 0;
             continue;
         }
         //B-TREE PACKING
-        qbnodes[i].btree->packing();
+        if (qbnodes[i].btree == group_tree)
+            pack_group(i);
+        else
+            qbnodes[i].btree->packing();
         vector<Node*> r = qbnodes[i].btree->allnodes();
+        // the same tree in the same leaf packs the same way
+        bool moved = qbnodes[i].btree->stamp != packed_stamp[i];
+        packed_stamp[i] = qbnodes[i].btree->stamp;
+        for (j = 0; j < r.size(); j++)
+        {
+            placed_leaf[r[j]->id] = i;
+            mod_moved[r[j]->id] |= moved;
+        }
 
         //x,y,rx,ry adjustment.
         if (qbnodes[qbnodes[i].parent].tl == i)
@@ -1960,10 +2577,30 @@ void QBtree::packing()
             }
         }
     }
+    place_islands();
     //COST CALUCLATION
     cost_evaluation();
 }
 
+//********** SPATIAL INDEX OF THE PACKED MODULES **********//
+// Built when first asked for after a packing; repairs that edit the trees
+// in between see the modules where they were packed, as modules_info does.
+void QBtree::index_placement()
+{
+    if (!placed_stale)
+        return;
+    vector<RECT> placed(modules_info.size());
+    for (int i = 0; i < modules_info.size(); i++)
+    {
+        placed[i].left = modules_info[i].x;
+        placed[i].right = modules_info[i].rx;
+        placed[i].bottom = modules_info[i].y;
+        placed[i].top = modules_info[i].ry;
+    }
+    placed_grid.build(qbnodes[0].boundRect, placed);
+    placed_stale = false;
+}
+
 //DISPLAY MODULES OF B*-TREES
 void QBtree::show_module()
 {
@@ -2129,204 +2766,243 @@ double QBtree::calcOutOfBoundArea()
 }
 
 //********** VIOLATION COST CALCULATION *********//
+// Violation cost as the sum of one term per constraint. Each term is kept
+// from the packing it was computed on and computed again only when one of
+// its modules was packed since; the terms are summed in the same order
+// every time, so the total is the one a full recompute gives, to the bit.
 double QBtree::calcViolationCost()
 {
-    int mid1, mid2;
-    double x, y, rx, ry, R, left, right, top, bottom, x1, x2, y1, y2;
+    bool all = full_check || mod_moved.size() != modules.size() ||
+               max_sep_terms.size() != constraints.max_sep.size() ||
+               range_terms.size() != constraints.range.size() ||
+               clto_terms.size() != constraints.clto_boundary.size();
+    if (all)
+    {
+        mod_moved.assign(modules.size(), 1);
+        max_sep_terms.resize(constraints.max_sep.size());
+        range_terms.resize(constraints.range.size());
+        clto_terms.resize(constraints.clto_boundary.size());
+    }
     double max_cost, cltobndry_cost, range_cost;
     max_cost = cltobndry_cost = range_cost = 0;
+
     //FOR MAXIMUM SEPARATION
-    if (!constraints.max_sep.empty())
+    for (int i = 0; i < constraints.max_sep.size(); i++)
     {
-        for (int i = 0; i < constraints.max_sep.size(); i++)
-        {
-            //get Module 1,2.
-            mid1 = constraints.max_sep[i].mod1;
-            mid2 = constraints.max_sep[i].mod2;
-
-            //get module_info.
-            x = modules_info[mid1].x;
-            y = modules_info[mid1].y;
-            rx = modules_info[mid1].rx;
-            ry = modules_info[mid1].ry;
-            R = constraints.max_sep[i].dis;
-            //determine module's boundary.
-            left = x > rx ? rx : x;
-            right = x > rx ? x : rx;
-            top = y > ry ? y : ry;
-            bottom = y > ry ? ry : y;
-            x1 = right - (right - left) / 2;
-            y1 = top - (top - bottom) / 2;
-
-            //get module_info.
-            x = modules_info[mid2].x;
-            y = modules_info[mid2].y;
-            rx = modules_info[mid2].rx;
-            ry = modules_info[mid2].ry;
-            //determine module's boundary.
-            left = x > rx ? rx : x;
-            right = x > rx ? x : rx;
-            top = y > ry ? y : ry;
-            bottom = y > ry ? ry : y;
-            x2 = right - (right - left) / 2;
-            y2 = top - (top - bottom) / 2;
-            R = sqrt(pow(x1 - x2, 2) + pow(y1 - y2, 2)) / R;
-            if (R <= 1)
-            {
-                R = 0;
-            }
-            max_cost += R;
-        }
+        if (mod_moved[constraints.max_sep[i].mod1] || mod_moved[constraints.max_sep[i].mod2])
+            max_sep_terms[i] = max_sep_term(i);
+        max_cost += max_sep_terms[i];
     }
-
     //FOR RANGE CONSTRAINT
-    if (!constraints.range.empty())
+    for (int i = 0; i < constraints.range.size(); i++)
     {
-        int index;
-        double t;
-        for (int i = 0; i < constraints.range.size(); i++)
-        {
-            mid1 = constraints.range[i].mod;
-            //get module_info.
-            x = modules_info[mid1].x;
-            y = modules_info[mid1].y;
-            rx = modules_info[mid1].rx;
-            ry = modules_info[mid1].ry;
-            //determine module's boundary.
-            left = x > rx ? rx : x;
-            right = x > rx ? x : rx;
-            top = y > ry ? y : ry;
-            bottom = y > ry ? ry : y;
-            //find node from module ID.
-            index = find_leaf_with_module(mid1);
+        if (mod_moved[constraints.range[i].mod])
+            range_terms[i] = range_term(i);
+        range_cost += range_terms[i];
+    }
+    //FOR CLOSE_TO_BOUNDARY CONSTRAINT
+    for (int i = 0; i < constraints.clto_boundary.size(); i++)
+    {
+        if (mod_moved[constraints.clto_boundary[i].mod])
+            clto_terms[i] = clto_term(i);
+        cltobndry_cost += clto_terms[i];
+    }
+    fill(mod_moved.begin(), mod_moved.end(), 0);
+    violation_parts[CONS_MAX_SEP] = max_cost;
+    violation_parts[CONS_RANGE] = range_cost;
+    violation_parts[CONS_CLTO] = cltobndry_cost;
 
-            if (strcmp(constraints.range[i].boundary, "TOP") == 0)
-            {
-                if (top > (qbnodes[index].boundRect.top - constraints.range[i].range))
-                {
-                    t = top - (qbnodes[index].boundRect.top - constraints.range[i].range);
+    //cout<<range_cost<<endl;
 
-                    if (t > (top - bottom))
-                        t = top - bottom;
+    return max_cost + range_cost + cltobndry_cost;
+}
 
-                    range_cost += t / (top - bottom);
-                }
-            }
-            if (strcmp(constraints.range[i].boundary, "BOTTOM") == 0)
-            {
-                if (bottom < (qbnodes[index].boundRect.bottom + constraints.range[i].range))
-                {
-                    t = abs((qbnodes[index].boundRect.bottom + constraints.range[i].range) - bottom);
+// Terms are the next packing's to compute again: the constraints changed.
+void QBtree::reset_violation()
+{
+    mod_moved.clear();
+}
 
-                    if (t > (top - bottom))
-                        t = top - bottom;
+double QBtree::max_sep_term(int i)
+{
+    int mid1, mid2;
+    double x, y, rx, ry, R, left, right, top, bottom, x1, x2, y1, y2;
+    //get Module 1,2.
+    mid1 = constraints.max_sep[i].mod1;
+    mid2 = constraints.max_sep[i].mod2;
+
+    //get module_info.
+    x = modules_info[mid1].x;
+    y = modules_info[mid1].y;
+    rx = modules_info[mid1].rx;
+    ry = modules_info[mid1].ry;
+    R = constraints.max_sep[i].dis;
+    //determine module's boundary.
+    left = x > rx ? rx : x;
+    right = x > rx ? x : rx;
+    top = y > ry ? y : ry;
+    bottom = y > ry ? ry : y;
+    x1 = right - (right - left) / 2;
+    y1 = top - (top - bottom) / 2;
+
+    //get module_info.
+    x = modules_info[mid2].x;
+    y = modules_info[mid2].y;
+    rx = modules_info[mid2].rx;
+    ry = modules_info[mid2].ry;
+    //determine module's boundary.
+    left = x > rx ? rx : x;
+    right = x > rx ? x : rx;
+    top = y > ry ? y : ry;
+    bottom = y > ry ? ry : y;
+    x2 = right - (right - left) / 2;
+    y2 = top - (top - bottom) / 2;
+    R = sqrt(pow(x1 - x2, 2) + pow(y1 - y2, 2)) / R;
+    if (R <= 1)
+    {
+        R = 0;
+    }
+    return R;
+}
 
-                    range_cost += t / (top - bottom);
-                }
-            }
-            if (strcmp(constraints.range[i].boundary, "LEFT") == 0)
-            {
-                if (left < (qbnodes[index].boundRect.left + constraints.range[i].range))
-                {
-                    t = abs((qbnodes[index].boundRect.left + constraints.range[i].range) - left);
+double QBtree::range_term(int i)
+{
+    int mid1, index;
+    double x, y, rx, ry, left, right, top, bottom, t;
+    mid1 = constraints.range[i].mod;
+    //get module_info.
+    x = modules_info[mid1].x;
+    y = modules_info[mid1].y;
+    rx = modules_info[mid1].rx;
+    ry = modules_info[mid1].ry;
+    //determine module's boundary.
+    left = x > rx ? rx : x;
+    right = x > rx ? x : rx;
+    top = y > ry ? y : ry;
+    bottom = y > ry ? ry : y;
+    //leaf the module was packed in.
+    index = placed_leaf[mid1];
+    const RECT& leaf = qbnodes[index].boundRect;
+
+    switch (constraints.range[i].side)
+    {
+    case RANGE_TOP:
+        if (top > (leaf.top - constraints.range[i].range))
+        {
+            t = top - (leaf.top - constraints.range[i].range);
 
-                    if (t > (right - left))
-                        t = right - left;
+            if (t > (top - bottom))
+                t = top - bottom;
 
-                    range_cost += t / (right - left);
-                }
-            }
-            if (strcmp(constraints.range[i].boundary, "RIGHT") == 0)
-            {
-                if (right > (qbnodes[index].boundRect.right - constraints.range[i].range))
-                {
-                    t = right - (qbnodes[index].boundRect.right - constraints.range[i].range);
+            return t / (top - bottom);
+        }
+        break;
+    case RANGE_BOTTOM:
+        if (bottom < (leaf.bottom + constraints.range[i].range))
+        {
+            t = abs((leaf.bottom + constraints.range[i].range) - bottom);
 
-                    if (t > (right - left))
-                        t = right - left;
+            if (t > (top - bottom))
+                t = top - bottom;
 
-                    range_cost += t / (right - left);
-                }
-            }
+            return t / (top - bottom);
         }
-    }
+        break;
+    case RANGE_LEFT:
+        if (left < (leaf.left + constraints.range[i].range))
+        {
+            t = abs((leaf.left + constraints.range[i].range) - left);
 
-    //FOR CLOSE_TO_BOUNDARY CONSTRAINT
-    if (!constraints.clto_boundary.empty())
-    {
-        int index, l, r, t, b;
-        for (int i = 0; i < constraints.clto_boundary.size(); i++)
-        {
-            //get Module
-            mid1 = constraints.clto_boundary[i].mod;
-            //get module_info.
-            x = modules_info[mid1].x;
-            y = modules_info[mid1].y;
-            rx = modules_info[mid1].rx;
-            ry = modules_info[mid1].ry;
-            R = constraints.clto_boundary[i].dis;
-            //determine module's boundary.
-            left = x > rx ? rx : x;
-            right = x > rx ? x : rx;
-            top = y > ry ? y : ry;
-            bottom = y > ry ? ry : y;
+            if (t > (right - left))
+                t = right - left;
 
-            index = find_leaf_with_module(mid1);
-            l = qbnodes[index].boundRect.left;
-            r = qbnodes[index].boundRect.right;
-            t = qbnodes[index].boundRect.top;
-            b = qbnodes[index].boundRect.bottom;
+            return t / (right - left);
+        }
+        break;
+    case RANGE_RIGHT:
+        if (right > (leaf.right - constraints.range[i].range))
+        {
+            t = right - (leaf.right - constraints.range[i].range);
 
-            if (left > (l + R) && right < (r - R) && top < (t - R) && bottom >(b + R))
-            {
-                cltobndry_cost += 1;
-            }
-            else
-            {
-                l = l + R;
-                r = r - R;
-                t = t - R;
-                b = b + R;
+            if (t > (right - left))
+                t = right - left;
 
-                if (left < l && right > l && top > t && bottom < t)
-                {
-                    cltobndry_cost += abs(((t - bottom) * (right - l)) / ((top - bottom) * (right - left)));
-                }
-                else if (left >= l && right <= r && top > t && bottom < t)
-                {
-                    cltobndry_cost += abs((t - bottom) / (top - bottom));
-                }
-                else if (left < r && right > r && top > t && bottom < t)
-                {
-                    cltobndry_cost += abs(((r - left) * (t - bottom)) / ((top - bottom) * (right - left)));
-                }
-                else if (left < r && right > r && top <= t && bottom >= b)
-                {
-                    cltobndry_cost += abs((r - left) / (right - left));
-                }
-                else if (left < r && right > r && top > b && bottom < b)
-                {
-                    cltobndry_cost += abs(((r - left) * (top - b)) / ((top - bottom) * (right - left)));
-                }
-                else if (left >= l && right <= r && top > b && bottom < b)
-                {
-                    cltobndry_cost += abs((top - b) / (top - bottom));
-                }
-                else if (left < l && right > l && top > b && bottom < b)
-                {
-                    cltobndry_cost += abs(((right - r) * (top - b)) / ((top - bottom) * (right - left)));
-                }
-                else if (left < l && right > l && top <= t && bottom >= b)
-                {
-                    cltobndry_cost += abs((right - r) / (right - left));
-                }
-            }
+            return t / (right - left);
         }
+        break;
     }
+    return 0;
+}
 
-    //cout<<range_cost<<endl;
+double QBtree::clto_term(int i)
+{
+    int mid1, index, l, r, t, b;
+    double x, y, rx, ry, R, left, right, top, bottom;
+    //get Module
+    mid1 = constraints.clto_boundary[i].mod;
+    //get module_info.
+    x = modules_info[mid1].x;
+    y = modules_info[mid1].y;
+    rx = modules_info[mid1].rx;
+    ry = modules_info[mid1].ry;
+    R = constraints.clto_boundary[i].dis;
+    //determine module's boundary.
+    left = x > rx ? rx : x;
+    right = x > rx ? x : rx;
+    top = y > ry ? y : ry;
+    bottom = y > ry ? ry : y;
 
-    return max_cost + range_cost + cltobndry_cost;
+    index = placed_leaf[mid1];
+    l = qbnodes[index].boundRect.left;
+    r = qbnodes[index].boundRect.right;
+    t = qbnodes[index].boundRect.top;
+    b = qbnodes[index].boundRect.bottom;
+
+    if (left > (l + R) && right < (r - R) && top < (t - R) && bottom >(b + R))
+    {
+        return 1;
+    }
+    else
+    {
+        l = l + R;
+        r = r - R;
+        t = t - R;
+        b = b + R;
+
+        if (left < l && right > l && top > t && bottom < t)
+        {
+            return abs(((t - bottom) * (right - l)) / ((top - bottom) * (right - left)));
+        }
+        else if (left >= l && right <= r && top > t && bottom < t)
+        {
+            return abs((t - bottom) / (top - bottom));
+        }
+        else if (left < r && right > r && top > t && bottom < t)
+        {
+            return abs(((r - left) * (t - bottom)) / ((top - bottom) * (right - left)));
+        }
+        else if (left < r && right > r && top <= t && bottom >= b)
+        {
+            return abs((r - left) / (right - left));
+        }
+        else if (left < r && right > r && top > b && bottom < b)
+        {
+            return abs(((r - left) * (top - b)) / ((top - bottom) * (right - left)));
+        }
+        else if (left >= l && right <= r && top > b && bottom < b)
+        {
+            return abs((top - b) / (top - bottom));
+        }
+        else if (left < l && right > l && top > b && bottom < b)
+        {
+            return abs(((right - r) * (top - b)) / ((top - bottom) * (right - left)));
+        }
+        else if (left < l && right > l && top <= t && bottom >= b)
+        {
+            return abs((right - r) / (right - left));
+        }
+    }
+    return 0;
 }
 
 //********** COST CALCULATION *********//
@@ -2347,20 +3023,13 @@ double QBtree::getCost()
     V = calcViolationCost();
 
     cost = alpha * WireLength * 1e-3 + beta * O / TotalArea + gamma * Area / TotalArea + ramda * V;
-
-    cout << "   WireLength : " << WireLength * 1e-3 << endl;
-    cout << "   Out of bound area : " << O * 1e-6 << endl;
-    cout << "   Area: " << Area * 1e-6 << endl;
-    cout << "   Total Area : " << TotalArea * 1e-6 << endl;
-    cout << "   Violation cost : " << V << endl;
-    cout << "   Total Cost : " << cost << endl;
-    cout << "                " << endl;
     return cost;
 }
 
 //********* COST EVALUTION **********//
 void QBtree::cost_evaluation()
 {
+    PROFILE_PHASE(PROF_COST);
     float alpha, beta, gamma, ramda;
     double O, V;
 
@@ -2376,21 +3045,38 @@ void QBtree::cost_evaluation()
     cost = alpha * WireLength * 1e-4 + beta * O / TotalArea + gamma * Area / TotalArea + ramda * V;
 
 }
-//********** SAVES CURRENT SOLUTION IF BETTER THAN PREVIOUS BEST SOLUTION *********//
-void QBtree::keep_sol(Solution& sol)
+//********** SOLUTION SNAPSHOTS *********//
+// A solution keeps each B*-tree as a vector<Node> in place of the B_Tree*.
+static void free_solution(Solution& sol)
 {
-    if (sol.cost != NIL)
+    for (int i = 0; i < sol.qbnodes.size(); i++)
     {
-        // delete prev
-        for (int i = 0; i < sol.qbnodes.size(); i++)
-            if (sol.qbnodes[i].btree)
-            {
-                vector<Node> t = *(vector<Node>*)sol.qbnodes[i].btree;
-                t.clear();
-
-            }
+        vector<Node>* t = (vector<Node>*)sol.qbnodes[i].btree;
+        if (t)
+        {
+            mem_free(MEM_SNAPSHOTS, t->capacity() * sizeof(Node));
+            delete t;
+            sol.qbnodes[i].btree = nullptr;
+        }
     }
+    sol.stamps.clear();
+}
+
+QBtree::~QBtree()
+{
+    for (int i = 0; i < b_trees.size(); i++)
+        delete b_trees[i];
+    free_solution(bestSolution);
+    free_solution(lastSolution);
+}
+
+//********** SAVES CURRENT SOLUTION IF BETTER THAN PREVIOUS BEST SOLUTION *********//
+void QBtree::keep_sol(Solution& sol)
+{
+    PROFILE_PHASE(PROF_KEEP_SOL);
+    free_solution(sol);
     sol.qbnodes = qbnodes;
+    sol.stamps.assign(qbnodes.size(), 0);
     // copy new
     for (int i = 0; i < qbnodes.size(); i++)
     {
@@ -2398,19 +3084,23 @@ void QBtree::keep_sol(Solution& sol)
         {
             auto btree_vector = new vector<Node>();
             qbnodes[i].btree->copyTree(*btree_vector);
+            mem_alloc(MEM_SNAPSHOTS, btree_vector->capacity() * sizeof(Node));
             sol.qbnodes[i].btree = (B_Tree*)btree_vector;
+            sol.stamps[i] = qbnodes[i].btree->stamp;
         }
         else
         {
             sol.qbnodes[i].btree = nullptr;
         }
     }
+    sol.islands = islands;
     sol.cost = cost;
 }
 
 //********** RECOVERS THE BEST SOLUTION *********//
 void QBtree::recover(Solution& sol)
 {
+    PROFILE_PHASE(PROF_RECOVER);
     for (int i = 0; i < b_trees.size(); i++)
     {
         b_trees[i]->destroy();
@@ -2418,6 +3108,8 @@ void QBtree::recover(Solution& sol)
     }
     b_trees.clear();
 
+    // before the trees, which take the islands' sizes
+    islands = sol.islands;
     qbnodes = sol.qbnodes;
     for (int i = 0; i < sol.qbnodes.size(); i++)
     {
@@ -2428,8 +3120,11 @@ void QBtree::recover(Solution& sol)
             auto tree = new vector<Node>();
             copyTree(t, tree);
             initBTree(*qbnodes[i].btree);
-            qbnodes[i].btree->nodes_root = tree->data();
+            qbnodes[i].btree->adoptTree(tree);
             qbnodes[i].btree->initWithOutNode();
+            // the same tree as when it was kept
+            if (i < sol.stamps.size())
+                qbnodes[i].btree->stamp = sol.stamps[i];
 
             b_trees.push_back(qbnodes[i].btree);
         }
@@ -2442,171 +3137,205 @@ void QBtree::recover(Solution& sol)
 }
 
 //********** COPY THE QB-TREE **********//
+// A snapshot is linked within its own vector, so links carry over by offset.
 void QBtree::copyTree(vector<Node>* tree_o, vector<Node>* tree)
 {
-    // copy tree vector.
-    for (int i = 0; i < tree_o->size(); i++)
+    tree->assign(tree_o->begin(), tree_o->end());
+    Node* from = tree_o->data();
+    Node* to = tree->data();
+    for (int i = 0; i < tree->size(); i++)
+    {
+        Node& n = tree->at(i);
+        n.parent = n.parent ? to + (n.parent - from) : nullptr;
+        n.left = n.left ? to + (n.left - from) : nullptr;
+        n.right = n.right ? to + (n.right - from) : nullptr;
+    }
+}
+
+//********** CHECKPOINT OF THE ANNEALING STATE **********//
+static void put_islands(Blob& b, const vector<SymmetryIsland>& islands)
+{
+    for (int i = 0; i < islands.size(); i++)
+        islands[i].save(b);
+}
+
+// "islands" as the constraints made them, their arrangements to be read
+static bool get_islands(Blob& b, vector<SymmetryIsland>& islands)
+{
+    for (int i = 0; i < islands.size(); i++)
+        if (!islands[i].load(b))
+            return false;
+    return true;
+}
+
+static void put_solution(Blob& b, Solution& sol)
+{
+    b.put(sol.cost);
+    put_islands(b, sol.islands);
+    for (int i = 0; i < sol.qbnodes.size(); i++)
     {
-        Node* node = (Node*) new unsigned char[sizeof(Node)];
-        node->id = tree_o->at(i).id;
-        node->flip = tree_o->at(i).flip;
-        node->rotate = tree_o->at(i).rotate;
-        node->ratio = tree_o->at(i).ratio;
-        node->parent = node->left = node->right = nullptr;
-        tree->push_back(*node);
+        vector<Node>* t = (vector<Node>*)sol.qbnodes[i].btree;
+        b.put(char(t != nullptr));
+        if (t)
+            b.put_tree(*t);
     }
+}
 
-    for (int i = 0; i < tree_o->size(); i++)
+static bool get_solution(Blob& b, Solution& sol, const vector<QBTreeNode>& qbnodes,
+                         const vector<SymmetryIsland>& islands)
+{
+    free_solution(sol);
+    sol.qbnodes = qbnodes;
+    sol.islands = islands;
+    if (!b.get(sol.cost) || !get_islands(b, sol.islands))
+        return false;
+    for (int i = 0; i < sol.qbnodes.size(); i++)
     {
-        for (int j = 0; j < tree_o->size(); j++)
+        char has_tree;
+        sol.qbnodes[i].btree = nullptr;
+        if (!b.get(has_tree))
+            return false;
+        if (has_tree)
         {
-            // j is i's parent.
-            if (&tree_o->at(j) == tree_o->at(i).parent)
-            {
-                tree->at(i).parent = &tree->at(j);
-            }
-            // j is i's left child
-            if (&tree_o->at(j) == tree_o->at(i).left)
+            auto t = new vector<Node>();
+            if (!b.get_tree(*t) || t->empty())
             {
-                tree->at(i).left = &tree->at(j);
-            }
-            // j is i's right child
-            if (&tree_o->at(j) == tree_o->at(i).right)
-            {
-                tree->at(i).right = &tree->at(j);
+                delete t;
+                return false;
             }
+            mem_alloc(MEM_SNAPSHOTS, t->capacity() * sizeof(Node));
+            sol.qbnodes[i].btree = (B_Tree*)t;
         }
     }
+    return true;
 }
 
-//********** SIMULATED ANNEALING SCHEME **********//
-double QBtree::SA_Floorplan(int k, int local, float term_T)
+// The quad partition is rebuilt from the input files and only checked here;
+// the B*-trees of the current, last and best solutions are stored.
+void QBtree::save_state(Blob& b)
 {
-    int MT, uphill, reject;
-    double pre_cost, best;
-    float d_cost, reject_rate;
-
-    int N = k * modules.size();
-    float P = 0.9;
-    float T, actual_T = 1;
-    double avg = init_avg;
-    float conv_rate = 1;
-    double time = seconds();
-
-
-    double estimate_avg = 0.08 / avg_ratio;
-    cout << "Estimate Average Delta Cost = " << estimate_avg << endl;
-
-    if (local == 0)
-        avg = estimate_avg;
+    b.put(int(qbnodes.size()));
+    for (int i = 0; i < qbnodes.size(); i++)
+        b.put(qbnodes[i].boundRect);
 
-    T = avg / log(P);
+    put_solution(b, lastSolution);
+    put_solution(b, bestSolution);
 
-    pre_cost = best = bestSolution.cost;
-    int good_num = 0, bad_num = 0;
-    double total_cost = 0;
-    int count = 0;
-    ofstream of("/tmp/btree_debug");
+    // current B*-trees in b_trees order, which the random picks depend on
+    b.put(int(b_trees.size()));
+    for (int i = 0; i < b_trees.size(); i++)
+    {
+        vector<Node> tree;
+        b_trees[i]->copyTree(tree);
+        b.put(int(find_qbnode_with_btree(b_trees[i]) - &qbnodes[0]));
+        b.put(char(!b_trees[i]->variants.empty()));
+        b.put_tree(tree);
+    }
+    put_islands(b, islands);
+    b.put(cost);
+}
 
-    do
+bool QBtree::load_state(Blob& b)
+{
+    int n;
+    if (!b.get(n) || n != qbnodes.size())
+        return false;
+    for (int i = 0; i < n; i++)
     {
-        double cn = 0;
-        float p_time = 0;
-        float pk_time = 0;
-        count++;
-        total_cost = 0;
-        MT = uphill = reject = 0;
-        printf("Iteration %d, T= %.2f\n", count, actual_T);
+        RECT r;
+        if (!b.get(r) || memcmp(&r, &qbnodes[i].boundRect, sizeof(RECT)))
+            return false;
+    }
 
-        vector<double> chain;
-        for (; uphill < N && MT < 2 * N; MT++)
-        {
-            perturbation();
-            packing();
-            d_cost = cost - pre_cost;
-            float p = exp(d_cost / T);
-            chain.push_back(cost);
+    if (!get_solution(b, lastSolution, qbnodes, islands) ||
+        !get_solution(b, bestSolution, qbnodes, islands))
+        return false;
 
-            if (d_cost <= 0 || rand_01() < p)
-            {
-                keep_sol(lastSolution);
-                pre_cost = cost;
-                if (d_cost > 0)
-                {
-                    uphill++, bad_num++;
-                    of << d_cost << ": " << p << endl;
-                }
-                else if (d_cost < 0)
-                    good_num++;
-                // keep best solution
-                if (cost < best)
-                {
-                    keep_sol(bestSolution);
-                    best = cost;
-                    printf("   ==>  Cost= %f, Area= %.6f, ", best, Area * 1e-6);
-                    printf("Wire= %.3f\n", WireLength * 1e-3);
-                    assert(calcNormalizeArea() >= TotalArea);
-                    time = seconds();
-                }
-            }
-            else
-            {
-                reject++;
-                recover(lastSolution);
-            }
-        }
-        double sv = std_var(chain);
-        float r_t = exp(lamda * T / sv);
-        T = r_t * T;
+    Solution current;
+    current.qbnodes = qbnodes;
+    current.islands = islands;
+    for (int i = 0; i < n; i++)
+        current.qbnodes[i].btree = nullptr;
 
-        // After apply local-search, start to use normal SA
-        if (count == local)
-        {
-            T = estimate_avg / log(P);
-            T *= pow(0.9, local); // smoothing the annealing schedule
-            actual_T = exp(estimate_avg / T);
-        }
-        if (count > local)
+    int trees;
+    if (!b.get(trees) || trees < 1 || trees > n)
+        return false;
+    vector<int> order(trees);
+    vector<char> has_variants(trees);
+    for (int i = 0; i < trees; i++)
+    {
+        auto t = new vector<Node>();
+        if (!b.get(order[i]) || order[i] < 0 || order[i] >= n ||
+            current.qbnodes[order[i]].btree ||
+            !b.get(has_variants[i]) || !b.get_tree(*t) || t->empty())
         {
-            actual_T = exp(estimate_avg / T);
-            conv_rate = 0.87;
+            delete t;
+            free_solution(current);
+            return false;
         }
+        mem_alloc(MEM_SNAPSHOTS, t->capacity() * sizeof(Node));
+        current.qbnodes[order[i]].btree = (B_Tree*)t;
+    }
+    if (!get_islands(b, current.islands) || !b.get(current.cost))
+    {
+        free_solution(current);
+        return false;
+    }
 
-        reject_rate = float(reject) / MT;
-        printf("  T= %.2f, r= %.2f, reject= %.2f\n", actual_T, r_t, reject_rate);
-    } while (reject_rate < conv_rate && actual_T > term_T);
-
-    if (reject_rate >= conv_rate)
-        cout << "\n  Convergent!\n";
-    else if (actual_T <= term_T)
-        cout << "\n Cooling Enough!\n";
-
-    printf("\n good = %d, bad=%d, rejected=%d\n\n", good_num, bad_num, reject);
+    recover(current);
+    free_solution(current);
 
-    recover(bestSolution);
+    // recover() builds the trees in quad-leaf order and without variants
+    for (int i = 0; i < trees; i++)
+    {
+        b_trees[i] = qbnodes[order[i]].btree;
+        if (has_variants[i])
+            b_trees[i]->variants = constraints.variant;
+    }
     packing();
-    return time;
+    return true;
 }
 
-double QBtree::std_var(vector<double>& chain)
+//********** QB-TREE AS SEEN BY THE ANNEALER **********//
+struct QBtreeProblem
 {
-    double m;
-    double sum = 0;
-    double var;
-    int N = chain.size();
-    for (int i = 0; i < chain.size(); i++)
-        sum += chain[i];
-
-    m = sum / N;
-    sum = 0;
-    for (int i = 0; i < N; i++)
-        sum += (chain[i] - m) * (chain[i] - m);
+    QBtree& qb;
+    QBtreeProblem(QBtree& qb) : qb(qb) {}
 
-    var = sqrt(sum / (N - 1));
-
-    printf("  m=%.4f ,v=%.4f\n", m, var);
+    int    size()       { return qb.modules.size(); }
+    // normalize_cost() already kept the best of its samples.
+    double start()      { return qb.bestSolution.cost; }
+    double move()
+    {
+        {
+            PROFILE_PHASE(PROF_PERTURB);
+            qb.perturbation();
+        }
+        qb.packing();
+        qb.step_moves++;
+        for (int k = 0; k < CONS_KINDS; k++)
+            qb.step_violation[k] += qb.violation_parts[k];
+        return qb.cost;
+    }
+    void   accept()     { qb.keep_sol(qb.lastSolution); }
+    void   reject()     { qb.recover(qb.lastSolution); }
+    void   keep_best()  { qb.keep_sol(qb.bestSolution); }
+    void   finish()     { qb.recover(qb.bestSolution); qb.packing(); }
+    double area()       { return qb.Area; }
+    double wirelength() { return qb.WireLength; }
+    // debug builds only, after every new best
+    bool   check()      { qb.verify_placement(0);
+                          return qb.calcNormalizeArea() >= qb.TotalArea; }
+    void   save(Blob& b) { qb.save_state(b); }
+    bool   load(Blob& b) { return qb.load_state(b); }
+    const char* step_fields() { return qb.step_fields(); }
+};
 
-    return var;
+//********** SIMULATED ANNEALING SCHEME **********//
+double QBtree::SA_Floorplan(int k, int local, float term_T)
+{
+    QBtreeProblem problem(*this);
+    return SA_Run(problem, k, local, term_T, 0.87);
 }
 
 //********** CREATING THE PLOT FOR MATLAB **********//
@@ -2748,6 +3477,47 @@ void QBtree::outPutResult(char* filepath)
     fclose(fs);
 }
 
+//********** CHECKS THE PLACEMENT FOR OVERLAPS **********//
+// Prints a summary and the first "shown" offenders if the placement is not
+// legal; returns the number of issues.
+int QBtree::verify_placement(int shown)
+{
+    vector<RECT> mods(modules_info.size());
+    for (int i = 0; i < modules_info.size(); i++)
+    {
+        mods[i].left = modules_info[i].x;
+        mods[i].right = modules_info[i].rx;
+        mods[i].bottom = modules_info[i].y;
+        mods[i].top = modules_info[i].ry;
+    }
+    vector<PlacementIssue> issues;
+    int n = find_overlaps(mods, rects, qbnodes[0].boundRect, issues);
+    if (n == 0)
+        return 0;
+
+    int count[3] = { 0, 0, 0 };
+    for (int i = 0; i < n; i++)
+        count[issues[i].kind]++;
+    printf("placement: %d module overlaps, %d pre-placed overlaps, "
+           "%d outside the outline\n", count[0], count[1], count[2]);
+    for (int i = 0; i < n && i < shown; i++)
+    {
+        PlacementIssue& p = issues[i];
+        if (p.kind == OVERLAP_MODULE)
+            printf("  %s overlaps %s by %ld\n", modules[p.a].name,
+                   modules[p.b].name, p.area);
+        else if (p.kind == OVERLAP_PPM)
+            printf("  %s overlaps pre-placed rect %d by %ld\n",
+                   modules[p.a].name, p.b, p.area);
+        else
+            printf("  %s is %ld outside the outline\n", modules[p.a].name,
+                   p.area);
+    }
+    if (n > shown && shown > 0)
+        printf("  ... %d more\n", n - shown);
+    return n;
+}
+
 bool QBtree::is_max_sep_module(int mid)
 {
     for (int i = 0; i < constraints.max_sep.size(); i++)
@@ -2759,4 +3529,114 @@ bool QBtree::is_max_sep_module(int mid)
     }
 
     return false;
-}
\ No newline at end of file
+}
+//********** SYMMETRY ISLANDS **********//
+// Each SYMMETRY group becomes one island, see symmetry.h. Its first module
+// is the anchor: the only one of the group left in the B*-trees, sized as
+// the island. The other members are placed around it after packing.
+void QBtree::build_islands()
+{
+    islands.clear();
+    mod_island.assign(modules.size(), NIL);
+    vector<char> used(modules.size(), 0);
+    for (int i = 0; i < constraints.symmetry.size();)
+    {
+        int group = constraints.symmetry[i].group;
+        vector<int> a, b, selfs;
+        for (; i < constraints.symmetry.size() && constraints.symmetry[i].group == group; i++)
+        {
+            int mod1 = constraints.symmetry[i].mod1;
+            int mod2 = constraints.symmetry[i].mod2;
+            if (mod1 == NIL || used[mod1] || (mod2 != NIL && (mod2 == mod1 || used[mod2])))
+            {
+                cout << "symmetry: module unknown or in two groups, entry " << i + 1 << " skipped" << endl;
+                continue;
+            }
+            used[mod1] = 1;
+            if (mod2 == NIL)
+            {
+                selfs.push_back(mod1);
+                continue;
+            }
+            used[mod2] = 1;
+            a.push_back(mod1);
+            b.push_back(mod2);
+        }
+        if (a.empty() && selfs.empty())
+            continue;
+        islands.push_back(SymmetryIsland());
+        islands.back().init(a, b, selfs, modules);
+    }
+
+    // take the members out of the trees and size the anchors as islands
+    for (int k = 0; k < islands.size(); k++)
+    {
+        const vector<int>& mods = islands[k].members;
+        for (int m = 1; m < mods.size(); m++)
+            for (int t = 0; t < b_trees.size(); t++)
+                if (b_trees[t]->allnodes().size() > 1 && b_trees[t]->take_node(mods[m]))
+                    break;
+        for (int m = 0; m < mods.size(); m++)
+            mod_island[mods[m]] = k;
+    }
+    for (int t = 0; t < b_trees.size(); t++)
+        resize_islands(*b_trees[t]);
+
+    // an island keeps its members' shapes
+    int dropped = 0;
+    for (int i = constraints.variant.size() - 1; i >= 0; i--)
+    {
+        if (mod_island[constraints.variant[i].mod] != NIL)
+        {
+            constraints.variant.erase(constraints.variant.begin() + i);
+            dropped++;
+        }
+    }
+    if (dropped > 0)
+        cout << "symmetry: " << dropped << " variant constraint(s) on symmetric modules ignored" << endl;
+}
+
+void QBtree::resize_islands(B_Tree& fp)
+{
+    for (int k = 0; k < islands.size(); k++)
+        fp.setModuleSize(islands[k].anchor(), islands[k].width, islands[k].height);
+}
+
+void QBtree::perturb_island()
+{
+    SymmetryIsland& island = islands[rand_int(islands.size())];
+    int anchor = island.anchor();
+    island.perturb();
+    for (int i = 0; i < b_trees.size(); i++)
+        b_trees[i]->setModuleSize(anchor, island.width, island.height);
+    // the anchor's tree packs differently now
+    int t = find_btree(anchor);
+    b_trees[t]->touch();
+    if (trajectory.recording())
+    {
+        int leaf = find_qbnode_with_btree(b_trees[t]) - &qbnodes[0];
+        trajectory.note(MOVE_ISLAND, anchor, leaf, leaf);
+    }
+}
+
+// members where the trees put their anchors
+void QBtree::place_islands()
+{
+    for (int k = 0; k < islands.size(); k++)
+    {
+        const vector<int>& mods = islands[k].members;
+        islands[k].place(modules_info[mods[0]], modules_info);
+        for (int m = 1; m < mods.size(); m++)
+        {
+            placed_leaf[mods[m]] = placed_leaf[mods[0]];
+            mod_moved[mods[m]] |= mod_moved[mods[0]];
+        }
+    }
+}
+
+int QBtree::anchor_of(int mod)
+{
+    if (mod == NIL || mod_island.empty() || mod_island[mod] == NIL)
+        return mod;
+    return islands[mod_island[mod]].anchor();
+}
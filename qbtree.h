@@ -8,9 +8,12 @@
 
 
 #include "btree.h"
+#include "symmetry.h"
+#include "spatial.h"
 
 #include "sa.h"
 
+#undef   SAFE_DELETE
 #define  SAFE_DELETE(p) {delete p; p= NULL;}
 
 using namespace std;
@@ -44,14 +47,19 @@ struct MAXIMUM_SEPERATION
 struct SYMMETRY
 {
     int mod1;
-    int mod2;
+    int mod2;       // NIL for a self-symmetric module
+    int group;      // SYMMETRY section it was read from
 };
 
 // Range Constriant
+enum RangeSide { RANGE_TOP, RANGE_BOTTOM, RANGE_LEFT, RANGE_RIGHT, RANGE_NONE };
+int range_side(const char* boundary);
+
 struct RANGE
 {
     int mod;
     char boundary[10];
+    int side;       // RangeSide named by boundary
     int range;
 };
 
@@ -80,9 +88,54 @@ struct Constraint
 struct Solution
 {
     vector<QBTreeNode>      qbnodes;
+    vector<long>            stamps;     // B_Tree::stamp of each qbnode's tree
+    vector<SymmetryIsland>  islands;
     double                  cost;
 };
 
+// Kinds of constraint, in the order they are checked
+enum ConsKind { CONS_MAX_SEP=0, CONS_RANGE, CONS_CLTO, CONS_PROXIMITY,
+                CONS_BOUNDARY, CONS_FIXED_BOUNDARY, CONS_KINDS };
+
+extern const char* cons_kind_names[CONS_KINDS];
+
+// Outcome of checking one constraint
+enum ConsStatus {
+    CONS_OK=0,      // satisfied
+    CONS_VIOLATED,  // violated; a repair was tried, check again next move
+    CONS_STOP,      // as CONS_VIOLATED, and the rest of its kind waits too
+    CONS_FAILED     // no repair found, perturb again
+};
+
+// One constraint: its kind and its index in the Constraint list
+struct ConsRef
+{
+    int kind;
+    int index;
+};
+
+// Constraint checks of one kind over the run
+struct RepairStats
+{
+    long checks;        // constraints checked
+    long skipped;       // not checked, their modules had not moved
+    long violations;    // found violated
+    long repairs;       // ... and the repair changed a B*-tree
+    long failures;      // ... and no tree was changed
+    double seconds;     // wall-clock time in the checks
+};
+
+// Check every constraint on every move, not only those whose modules moved.
+extern bool full_check;
+// Perturbations a move may try for constraints that can be repaired; the
+// last one then stands, violations and all (0 = no limit).
+extern int  repair_retries;
+// Keep BOUNDARY and FIXED_BOUNDARY modules on the root's left or right
+// chain of their B*-tree, which packing puts against the leaf's edges.
+extern bool pin_boundary;
+// Keep the PROXIMITY group in one B*-tree as a subtree of its own.
+extern bool cluster_proximity;
+
 // QB-tree Class
 class QBtree
 {
@@ -95,7 +148,6 @@ public:
     Modules_Info            modules_info;  
     vector<Module>          modules;
     int                     modules_N;
-    vector<vector<int>>     connection;
     map<string,int>         net_table;
     Module                  root_module;
     double                  WireLength;
@@ -116,6 +168,71 @@ public:
     Solution                lastSolution;
     double                  normal_cost,cost;
 
+    // incremental constraint checking: the constraints on each module, and
+    // the tree stamps each constraint last held on
+    vector<ConsRef>         cons_refs;
+    vector<vector<int> >    cons_mods;      // modules of each constraint
+    vector<vector<long> >   cons_held;      // stamps of their trees then
+    vector<char>            cons_clean;     // the trees are as they were
+    vector<vector<int> >    mod_cons;       // constraints on each module
+    vector<long>            mod_stamp;      // stamp of each module's tree
+    vector<int>             mod_repaired;   // last check a repair moved it
+    vector<int>             mod_leaf;
+    vector<long>            leaf_stamp;
+    int                     check_count;
+
+    // the proximity group's tree nodes (--cluster-proximity), a flag for
+    // each module in it, whether the last packing held it in one tree, and
+    // the tree gathering it
+    vector<int>             group_mods;
+    vector<char>            mod_grouped;
+    bool                    group_held;
+    B_Tree*                 group_tree;
+
+    // modules every B*-tree keeps on a chain (--pin-boundary), and those of
+    // them whose boundary constraints then need no checking
+    vector<int>             pinned_mods;
+    vector<char>            mod_pinned;
+
+    // quad leaves of the partition, which may hold a B*-tree
+    vector<int>             quad_leaves;
+
+    // the quad leaves and, as last packed, the modules by position
+    SpatialGrid             leaf_grid, placed_grid;
+    bool                    placed_stale;   // packed since placed_grid was built
+    vector<int>             grid_found;
+
+    // violation cost, a term per constraint kept from packing to packing:
+    // the leaf each module was packed in, the stamp of the tree each leaf
+    // packed, and the modules packed differently since the terms were taken
+    vector<int>             placed_leaf;
+    vector<long>            packed_stamp;
+    vector<char>            mod_moved;
+    vector<double>          max_sep_terms, range_terms, clto_terms;
+
+    // maximum separation: squared distance of each pair as last packed,
+    // less the square it must stay under (>= 0 is too far)
+    vector<double>          max_sep_pass;
+    const double*           max_sep_over;
+
+    // symmetry groups, each packed as one island in place of its anchor
+    vector<SymmetryIsland>  islands;
+    vector<int>             mod_island;     // island of each module, or NIL
+
+    // constraint repair over the run
+    RepairStats             repair_stats[CONS_KINDS];
+    // violation cost of each kind as last computed; the sum of it over the
+    // moves of this temperature step, and the repairs as the step began
+    double                  violation_parts[CONS_KINDS];
+    double                  step_violation[CONS_KINDS];
+    long                    step_moves;
+    RepairStats             step_start[CONS_KINDS];
+    string                  step_json;
+    long                    proposals, perturbations, fallbacks;
+    int                     longest_chain;
+
+                            ~QBtree();
+
     void                    init(float alpha, char* filename, int times, int local, float term_temp);
     void                    read_module_info();
     void                    read_dimension(Module &mod);
@@ -125,6 +242,7 @@ public:
     void                    makeQBTreeRoot(const vector<RECT>& rects);
     void                    readPreplacedModules();
     void                    readConstraint(char* file);
+    void                    check_feasibility();
     long                    getC(long y, const vector<RECT>& rects, int except_id);
     void                    qSplit(int parent, const vector<RECT>& rects);
     void                    showQBTree();
@@ -139,6 +257,9 @@ public:
     int                     find_leaf_with_module(int mod_id);
     int                     find_mod_id_with_module_name(char* module_name);
     void                    perturbation();
+    void                    repair_report();
+    const char*             step_fields();
+    int                     count_constraints(int kind);
     void                    normalize_cost(int time);
     void                    move_node_to_quad_leaf();
     void                    move_node_to_b();
@@ -148,6 +269,22 @@ public:
     void                    show_module();
     int                     getModuleIDWithModuleName(char* moduleName);
     bool                    constraintChecking();
+    void                    index_constraints();
+    void                    add_constraint(int kind, int index, const vector<int> &mods);
+    void                    mark_moved_constraints(bool repair);
+    void                    hold_constraint(int c);
+    int                     check_constraint(const ConsRef &c);
+    void                    index_placement();
+    void                    pin_modules();
+    void                    cluster_modules();
+    void                    gather_proximity();
+    void                    pack_group(int leaf);
+    void                    measure_max_sep();
+    int                     check_max_sep(int i);
+    int                     check_range(int i);
+    int                     check_clto(int i);
+    int                     check_proximity();
+    int                     check_boundary(int mod);
     bool                    maximum_seperation();
     bool                    minimum_seperation();
     bool                    range_cons();
@@ -157,6 +294,7 @@ public:
     bool                    proximity();
     bool                    candidateGeneration(int constraint, int mod_id, int index);
     void                    Op3(int index, int op_index, int mod_id);
+    bool                    Op4(int mod_id, int to_mod_id);
     void                    Op2(int op_mod_id, int mod_id);
     void                    Op1(int index, int op_index, int mod_id);
     double                  calcWireLength();
@@ -164,15 +302,26 @@ public:
     double                  calcNormalizeArea();
     double                  calcOutOfBoundArea();
     double                  calcViolationCost();
+    void                    reset_violation();
+    double                  max_sep_term(int i);
+    double                  range_term(int i);
+    double                  clto_term(int i);
     char*                   tail(char *str);
     void                    keep_sol(Solution &sol);
     void                    recover(Solution &sol);
     void                    cost_evaluation();
     double                  SA_Floorplan(int k, int local, float term_T);
-    double                  std_var(vector<double> &chain);
     void                    outPutResult(char *filepath);
     void                    copyTree(vector<Node> *tree_o, vector<Node> *tree);
+    void                    save_state(Blob &b);
+    bool                    load_state(Blob &b);
     bool                    is_max_sep_module(int mid);
+    void                    build_islands();
+    void                    resize_islands(B_Tree &fp);
+    void                    perturb_island();
+    void                    place_islands();
+    int                     anchor_of(int mod);
+    int                     verify_placement(int shown);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Seeded runs that once ended in an illegal placement: each must now pack
+# with no overlap and no module outside the outline.
+#
+#   sh regress.sh [outdir]
+#
+# Each case is a design, its times, local and avg_ratio, and the btree
+# options. Everything btree writes, the .res file included, stays under
+# outdir. Exits 1 if any run is not legal.
+
+OUT=${1:-regress_out}
+BTREE=`pwd`/btree
+
+# --cluster-proximity gathered the group into a subtree wider or taller than
+# its leaf: up to 4 modules out. The runs of ami33.run and apte.run, and the
+# shorter ones it first showed up in.
+CASES="ami33:1400:13:160:--seed=1:--cluster-proximity
+ami33:1400:13:160:--seed=2:--cluster-proximity
+apte:60:0:20:--seed=1:--cluster-proximity
+apte:60:0:20:--seed=2:--cluster-proximity
+apte:60:0:20:--seed=3:--cluster-proximity
+ami33:60:0:20:--seed=1:--cluster-proximity
+ami33:60:0:20:--seed=3:--cluster-proximity
+ami33:60:0:20:--seed=4:--cluster-proximity
+ami33:60:7:20:--seed=3:--cluster-proximity
+ami33:60:7:20:--seed=4:--cluster-proximity
+ami33:60:7:20:--seed=5:--cluster-proximity
+ami33:60:13:160:--seed=3:--cluster-proximity
+ami33:60:13:160:--seed=4:--cluster-proximity
+ami33:60:13:160:--seed=5:--cluster-proximity"
+
+mkdir -p $OUT || exit 1
+rm -f $OUT/*.res
+failed=0
+n=0
+for c in $CASES; do
+  set -- `echo $c | tr ':' ' '`
+  d=$1; run="$2 $3 $4"; shift 4
+  n=`expr $n + 1`
+  # btree writes its outputs next to the design, so run on a copy
+  cp $d $OUT/ || exit 1
+  [ -f ${d}_constraint ] && cp ${d}_constraint $OUT/
+  rm -f $OUT/$d.$n.jsonl
+  (cd $OUT && $BTREE $d $run 1 1.3 0.1 $d.res "$@" --quiet \
+      --report=$d.$n.jsonl > $d.$n.log 2>&1)
+  if grep -q '"overlaps":0,' $OUT/$d.$n.jsonl 2>/dev/null; then
+    echo "regress: $d $run $*: legal"
+  else
+    echo "regress: $d $run $*: NOT legal, see $OUT/$d.$n.log"
+    failed=1
+  fi
+done
+exit $failed
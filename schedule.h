@@ -0,0 +1,353 @@
+//---------------------------------------------------------------------------
+#ifndef scheduleH
+#define scheduleH
+//---------------------------------------------------------------------------
+#include <cmath>
+#include <cstring>
+#include <iostream>
+//---------------------------------------------------------------------------
+extern float init_avg;
+extern float avg_ratio;
+extern float lamda;
+extern int   sa_schedule;
+extern float geo_alpha;
+extern int   fsa_c;
+extern int   lam_steps;
+
+/* Cooling schedules for the Annealer (annealer.h).
+
+   All schedules keep the original sign convention: T is negative and an
+   uphill move is accepted with probability exp(d_cost/T). actual_T is the
+   probability of accepting an average uphill move; it starts near 1 and
+   the anneal is "cool enough" once it falls below term_T.
+
+   A schedule provides
+     void start()                  set the initial temperature
+     void update(const TempStep&)  adjust T after one temperature step
+     void fit(const TempStep&, double steps)
+                                   cool fast enough to be done within
+                                   about "steps" more steps (--compress)
+     int  stop(const TempStep&)    SA_RUNNING or the reason to stop
+   and the members T, actual_T and ratio (last change of T), and the
+   enum "id" (its SA_Schedule). Schedules hold plain values only, so a
+   checkpoint stores them as raw bytes.
+*/
+
+// Streaming mean and variance (Welford), without keeping the samples.
+struct RunningStats{
+  long   n;
+  double mean, m2;
+
+  RunningStats() { clear(); }
+  void clear() { n = 0; mean = m2 = 0; }
+  void add(double x){
+    n++;
+    double d = x - mean;
+    mean += d / n;
+    m2 += d * (x - mean);
+  }
+  double var() const     { return n > 1 ? m2 / (n-1) : 0; }
+  double std_dev() const { return sqrt(var()); }
+};
+
+// Summary of one temperature step handed to the cooling schedule.
+struct TempStep{
+  int count;            // temperature steps done so far
+  int moves;            // moves tried at this temperature
+  int uphill;           // accepted uphill moves
+  int reject;           // rejected moves
+  double cost_mean;     // mean of the costs seen
+  double std_dev;       // standard deviation of the costs seen
+  double delta_mean;    // mean cost change of the proposals
+  double delta_var;     // variance of the cost change
+  double best_delta;    // largest cost decrease proposed (most negative)
+  double avg_uphill;    // mean cost increase of the uphill proposals
+  float reject_rate;
+  float accept_rate;
+};
+
+// Why an anneal stopped.
+enum SA_Stop { SA_RUNNING=0, SA_CONVERGENT, SA_COOLED,
+               SA_TIME_LIMIT, SA_MOVE_LIMIT, SA_INTERRUPTED };
+
+inline const char* sa_stop_name(int s){
+  static const char *names[] = { "running", "convergent", "cooled",
+                                 "time_limit", "move_limit", "interrupted" };
+  return names[s];
+}
+
+enum SA_Schedule { SCHED_CLASSIC=0, SCHED_FAST, SCHED_LAM, SCHED_GEOMETRIC };
+
+inline int schedule_by_name(const char *name){
+  if(!strcmp(name,"classic"))   return SCHED_CLASSIC;
+  if(!strcmp(name,"fast"))      return SCHED_FAST;
+  if(!strcmp(name,"lam"))       return SCHED_LAM;
+  if(!strcmp(name,"geometric")) return SCHED_GEOMETRIC;
+  return -1;
+}
+
+inline const char* schedule_name(int s){
+  static const char *names[] = { "classic", "fast", "lam", "geometric" };
+  return names[s];
+}
+
+/* Squeeze the last cooling step so that T reaches the temperature at which
+   an average uphill move (avg) is accepted with probability term_T after
+   "steps" more steps. T and ratio are the values update() just set.
+*/
+inline void fit_cooling(float &T, float &ratio, float &actual_T,
+                        double avg, float term_T, double steps)
+{
+  if(steps < 1) steps = 1;
+  float prev  = T / ratio;
+  float T_end = avg / log(term_T);
+  float need  = pow(T_end/prev, 1/(steps+1));
+  if(need < ratio){
+    ratio = need;
+    T = prev * ratio;
+    actual_T = exp(avg/T);
+  }
+}
+
+/* The original B*-tree schedule.
+   T = avg/log(P) to start, then T is scaled by exp(lamda*T/sigma) after
+   every step. The first "local" steps are a hill climb, after which T is
+   reset and the run stops once the reject rate reaches conv_rate or the
+   displayed temperature falls below term_T.
+*/
+class ClassicSchedule{
+  public:
+    enum { id = SCHED_CLASSIC };
+
+    ClassicSchedule(int local, float term_T, float conv_rate)
+      : local(local), term_T(term_T), final_conv(conv_rate) {}
+
+    void start(){
+      P = 0.9;
+      actual_T = 1;
+      ratio = 1;
+      conv_rate = 1;
+      estimate_avg = 0.08 / avg_ratio;
+      std::cout << "Estimate Average Delta Cost = " << estimate_avg << std::endl;
+
+      double avg = init_avg;
+      if(local==0)
+        avg = estimate_avg;
+      T = avg / log(P);
+    }
+
+    void update(const TempStep &s){
+      ratio = exp(lamda*T/s.std_dev);
+      T = ratio*T;
+
+      // After apply local-search, start to use normal SA
+      if(s.count == local){
+        T = estimate_avg / log(P);
+        T *= pow(0.9,local);		// smoothing the annealing schedule
+        actual_T = exp(estimate_avg/T);
+      }
+      if(s.count > local){
+        actual_T = exp(estimate_avg/T);
+        conv_rate = final_conv;
+      }
+    }
+
+    void fit(const TempStep &s, double steps){
+      if(s.count > local)
+        fit_cooling(T, ratio, actual_T, estimate_avg, term_T, steps);
+    }
+
+    int stop(const TempStep &s){
+      if(s.reject_rate >= conv_rate) return SA_CONVERGENT;
+      if(actual_T <= term_T)         return SA_COOLED;
+      return SA_RUNNING;
+    }
+
+    float T;            // temperature used by the acceptance test
+    float actual_T;     // temperature shown to the user
+    float ratio;        // last cooling ratio
+
+  private:
+    int    local;
+    float  term_T, final_conv, conv_rate;
+    float  P;
+    double estimate_avg;
+};
+
+/* Fast-SA (Chen & Chang, TCAD 2006), three stages:
+     n = 1        hill climbing, measures the average uphill cost delta1
+                  of the proposals
+     2 <= n <= k  T = T1*<d>/(n*c)  pseudo-greedy local search
+     n > k        T = Tk*<d>/n      hill climbing
+   T1 = avg/ln(P) with the estimate avg of the other schedules, and <d> is
+   the average uphill delta of the last step relative to delta1. k is the
+   hill_climb_stage argument.
+   Two changes from the paper. Stage 1 runs at the classic hill-climbing
+   temperature, not an infinite one: a random walk here leaves modules out
+   of the outline where the later stages cannot get them back, and the
+   proposals give delta1 all the same. Tk is the stage-2 constant T1/c, so
+   T carries on from the end of stage 2 instead of jumping by c.
+*/
+class FastSchedule{
+  public:
+    enum { id = SCHED_FAST };
+
+    FastSchedule(int k, float term_T, float conv_rate)
+      : k(k < 1 ? 1 : k), term_T(term_T), conv_rate(conv_rate) {}
+
+    void start(){
+      P = 0.99;
+      estimate_avg = 0.08 / avg_ratio;
+      T1 = estimate_avg / log(P);
+      Tk = T1 / fsa_c;
+      T = init_avg / log(P);
+      actual_T = 1;
+      ratio = 1;
+      delta1 = 0;
+      squeeze = 1;
+    }
+
+    void update(const TempStep &s){
+      float prev = T;
+      if(s.count == 1)
+        delta1 = s.avg_uphill > 0 ? s.avg_uphill : estimate_avg;
+
+      int n = s.count + 1;       // the step about to run
+      double d = s.avg_uphill > 0 ? s.avg_uphill / delta1 : 1;
+      if(n <= k)
+        T = T1 * d / (n * fsa_c);
+      else
+        T = Tk * d / n * squeeze;
+
+      ratio = T / prev;
+      actual_T = exp(estimate_avg / T);
+    }
+
+    void fit(const TempStep &s, double steps){
+      if(s.count <= k)           // let the hill climbing stage start
+        return;
+      float before = T;
+      fit_cooling(T, ratio, actual_T, estimate_avg, term_T, steps);
+      squeeze *= T / before;
+    }
+
+    int stop(const TempStep &s){
+      if(s.count > k && s.reject_rate >= conv_rate) return SA_CONVERGENT;
+      if(s.count > k && actual_T <= term_T)         return SA_COOLED;
+      return SA_RUNNING;
+    }
+
+    float T, actual_T, ratio;
+
+  private:
+    int    k;
+    float  term_T, conv_rate;
+    float  P;
+    double estimate_avg, delta1, T1, Tk;
+    double squeeze;     // extra cooling applied by fit()
+};
+
+/* Modified Lam schedule: steer T so that the acceptance ratio follows
+   the Lam-Delosme target curve over a planned run of lam_steps steps.
+     f < 0.15          0.44 + 0.56 * 560^(-f/0.15)
+     0.15 <= f < 0.65  0.44
+     f >= 0.65         0.44 * 440^(-(f-0.65)/0.35)
+   The run ends after the planned number of steps.
+*/
+class LamSchedule{
+  public:
+    enum { id = SCHED_LAM };
+
+    LamSchedule() {}
+
+    static double target(double f){
+      if(f < 0.15) return 0.44 + 0.56 * pow(560.0, -f/0.15);
+      if(f < 0.65) return 0.44;
+      return 0.44 * pow(440.0, -(f-0.65)/0.35);
+    }
+
+    void start(){
+      P = 0.9;
+      ratio = 1;
+      steps = lam_steps;
+      estimate_avg = 0.08 / avg_ratio;
+      T = estimate_avg / log(P);
+      actual_T = exp(estimate_avg/T);
+    }
+
+    void update(const TempStep &s){
+      double f = double(s.count) / steps;
+      double accept = 1 - s.reject_rate;
+      // |T| up when accepting too little, down when accepting too much
+      ratio = exp(3 * (target(f) - accept));
+      if(ratio < 0.5) ratio = 0.5;
+      if(ratio > 2)   ratio = 2;
+      T = ratio * T;
+      actual_T = exp(estimate_avg/T);
+    }
+
+    // shorten the plan instead of cooling harder
+    void fit(const TempStep &s, double left){
+      int more = left < 1 ? 1 : int(left);
+      if(s.count + more < steps)
+        steps = s.count + more;
+    }
+
+    int stop(const TempStep &s){
+      if(s.count >= steps) return SA_COOLED;
+      return SA_RUNNING;
+    }
+
+    float T, actual_T, ratio;
+
+  private:
+    int    steps;
+    float  P;
+    double estimate_avg;
+};
+
+/* Geometric cooling, T(n+1) = geo_alpha * T(n), from the classic initial
+   temperature. Stops like the classic schedule once past "local" steps.
+*/
+class GeometricSchedule{
+  public:
+    enum { id = SCHED_GEOMETRIC };
+
+    GeometricSchedule(int local, float term_T, float conv_rate)
+      : local(local), term_T(term_T), conv_rate(conv_rate) {}
+
+    void start(){
+      P = 0.9;
+      ratio = geo_alpha;
+      estimate_avg = 0.08 / avg_ratio;
+      T = estimate_avg / log(P);
+      actual_T = exp(estimate_avg/T);
+    }
+
+    void update(const TempStep &s){
+      T = ratio * T;
+      actual_T = exp(estimate_avg/T);
+    }
+
+    // keeps the faster rate for the rest of the run
+    void fit(const TempStep &s, double steps){
+      fit_cooling(T, ratio, actual_T, estimate_avg, term_T, steps);
+    }
+
+    int stop(const TempStep &s){
+      if(s.count > local && s.reject_rate >= conv_rate) return SA_CONVERGENT;
+      if(actual_T <= term_T)                            return SA_COOLED;
+      return SA_RUNNING;
+    }
+
+    float T, actual_T, ratio;
+
+  private:
+    int    local;
+    float  term_T, conv_rate;
+    float  P;
+    double estimate_avg;
+};
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,95 @@
+//---------------------------------------------------------------------------
+#include <cmath>
+#include <algorithm>
+#include "spatial.h"
+#include "qbtree.h"
+//---------------------------------------------------------------------------
+
+int SpatialGrid::column(long x) const {
+  long c = (x - x0) / bin_w;
+  return c < 0 ? 0 : (c >= nx ? nx - 1 : int(c));
+}
+
+int SpatialGrid::row(long y) const {
+  long r = (y - y0) / bin_h;
+  return r < 0 ? 0 : (r >= ny ? ny - 1 : int(r));
+}
+
+void SpatialGrid::build(const RECT &area, const vector<RECT> &rects)
+{
+  int n = rects.size();
+  long w = max(1L, labs(area.right - area.left));
+  long h = max(1L, labs(area.top - area.bottom));
+  x0 = min(area.left, area.right);
+  y0 = min(area.bottom, area.top);
+
+  // about one bin per rect, the bins about square
+  double side = sqrt(double(w) * h / max(1, n));
+  nx = max(1, min(n, int(w / max(1.0, side))));
+  ny = max(1, min(n, int(h / max(1.0, side))));
+  bin_w = (w + nx - 1) / nx;
+  bin_h = (h + ny - 1) / ny;
+
+  box.resize(4 * n);
+  seen.assign(n, 0);
+  epoch = 0;
+  first.assign(nx * ny + 1, 0);
+  for(int pass=0; pass < 2; pass++){
+    for(int i=0; i < n; i++){
+      long l = min(rects[i].left, rects[i].right);
+      long r = max(rects[i].left, rects[i].right);
+      long b = min(rects[i].bottom, rects[i].top);
+      long t = max(rects[i].bottom, rects[i].top);
+      if(l == r || b == t)
+        continue;
+      if(pass == 0){
+        box[4*i] = l, box[4*i+1] = b, box[4*i+2] = r, box[4*i+3] = t;
+      }
+      for(int y=row(b); y <= row(t); y++)
+        for(int x=column(l); x <= column(r); x++){
+          if(pass == 0)
+            first[y*nx + x + 1]++;
+          else
+            ids[first[y*nx + x]++] = i;
+        }
+    }
+    if(pass == 0){
+      // counts to the start of each bin
+      for(int c=0; c < nx*ny; c++)
+        first[c+1] += first[c];
+      ids.resize(first[nx*ny]);
+    }
+    else{
+      // each start was moved on to the next bin's
+      for(int c=nx*ny; c > 0; c--)
+        first[c] = first[c-1];
+      first[0] = 0;
+    }
+  }
+}
+
+void SpatialGrid::query(const RECT &q, vector<int> &found)
+{
+  found.clear();
+  if(nx == 0)
+    return;
+  long l = min(q.left, q.right), r = max(q.left, q.right);
+  long b = min(q.bottom, q.top), t = max(q.bottom, q.top);
+  if(++epoch == 0){
+    seen.assign(seen.size(), 0);
+    epoch = 1;
+  }
+  for(int y=row(b); y <= row(t); y++)
+    for(int x=column(l); x <= column(r); x++){
+      int c = y*nx + x;
+      for(int k=first[c]; k < first[c+1]; k++){
+        int i = ids[k];
+        if(seen[i] == epoch)
+          continue;
+        seen[i] = epoch;
+        if(box[4*i] <= r && box[4*i+2] >= l && box[4*i+1] <= t && box[4*i+3] >= b)
+          found.push_back(i);
+      }
+    }
+  sort(found.begin(), found.end());
+}
@@ -0,0 +1,40 @@
+//---------------------------------------------------------------------------
+#ifndef spatialH
+#define spatialH
+//---------------------------------------------------------------------------
+#include <vector>
+using namespace std;
+//---------------------------------------------------------------------------
+struct RECT;
+
+/* Uniform bin grid over a set of rects, for region queries that cost the
+   bins they cover and the rects they find rather than the whole set. The
+   grid spans "area" in about one bin per rect; rects reaching out of it
+   are kept in the border bins, so every rect can still be found. Rects may
+   give their corners in any order; empty ones are left out.
+*/
+class SpatialGrid{
+  public:
+    SpatialGrid() : nx(0), ny(0), epoch(0) {}
+
+    void build(const RECT &area, const vector<RECT> &rects);
+
+    // ids of the rects sharing a point with r, edges included, ascending;
+    // replaces the contents of "found"
+    void query(const RECT &r, vector<int> &found);
+
+  private:
+    int  column(long x) const;
+    int  row(long y) const;
+
+    long x0, y0, bin_w, bin_h;
+    int  nx, ny;
+    vector<int>  first;         // bin b holds ids[first[b] .. first[b+1])
+    vector<int>  ids;
+    vector<long> box;           // left, bottom, right, top of each rect
+    vector<int>  seen;          // query stamp of each rect
+    int  epoch;
+};
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,189 @@
+//---------------------------------------------------------------------------
+#include <cmath>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include "symmetry.h"
+#include "btree.h"
+#include "checkpoint.h"
+//---------------------------------------------------------------------------
+
+void SymmetryIsland::init(const vector<int> &a, const vector<int> &b,
+                          const vector<int> &selfs, const Modules &modules)
+{
+  items.clear();
+  members.clear();
+  for(int i=0; i < a.size() + selfs.size(); i++){
+    Item it;
+    it.mod  = i < a.size() ? a[i] : selfs[i - a.size()];
+    it.mate = i < a.size() ? b[i] : NIL;
+    it.w = modules[it.mod].width;
+    it.h = modules[it.mod].height;
+    it.x = it.y = 0;
+    it.rotate = false;
+    items.push_back(it);
+    members.push_back(it.mod);
+    if(it.mate != NIL)
+      members.push_back(it.mate);
+  }
+  order.resize(items.size());
+  for(int i=0; i < order.size(); i++)
+    order[i] = i;
+  stretch = 0;
+  pack();
+}
+
+void SymmetryIsland::perturb()
+{
+  int n = items.size();
+  if(rand_int(3) == 0){
+    // wider or taller, the way that stays in range
+    int step = rand_bool() ? 1 : -1;
+    if(abs(stretch + step) > max_stretch)
+      step = -step;
+    stretch += step;
+    pack();
+    return;
+  }
+  int i = rand_int(n);
+  Item &it = items[order[i]];
+  if(n > 1 && (it.mate == NIL || rand_bool())){
+    int j = rand_int(n - 1);
+    if(j >= i) j++;
+    swap(order[i], order[j]);
+  }
+  else if(it.mate != NIL)
+    it.rotate = !it.rotate;
+  pack();
+}
+
+void SymmetryIsland::pack()
+{
+  // width in the right half: a self-symmetric module shows half of itself
+  long area = 0;
+  int widest = 0;
+  for(int i=0; i < items.size(); i++){
+    Item &it = items[i];
+    int w = it.mate == NIL ? (it.w + 1) / 2 : (it.rotate ? it.h : it.w);
+    int h = it.rotate ? it.w : it.h;
+    area += long(w) * h;
+    widest = max(widest, w);
+  }
+  int limit = max(widest, int(sqrt(double(area)) * pow(1.25, stretch) + 0.5));
+
+  // skyline: height ys[k] from xs[k] up to the next step, or to limit
+  vector<int> xs(1, 0), ys(1, 0);
+  half = height = 0;
+  for(int n=0; n < order.size(); n++){
+    Item &it = items[order[n]];
+    int w = it.mate == NIL ? (it.w + 1) / 2 : (it.rotate ? it.h : it.w);
+    int h = it.rotate ? it.w : it.h;
+
+    // lowest, then leftmost, step the item fits on; the axis for a
+    // self-symmetric one
+    int best_x = 0, best_y = INT_MAX;
+    for(int k=0; k < xs.size(); k++){
+      if(xs[k] + w > limit || (it.mate == NIL && k > 0))
+        break;
+      int y = 0;
+      for(int j=k; j < xs.size() && xs[j] < xs[k] + w; j++)
+        y = max(y, ys[j]);
+      if(y < best_y){
+        best_x = xs[k];
+        best_y = y;
+      }
+    }
+    it.x = best_x;
+    it.y = best_y;
+
+    // raise [x, x+w) to the item's top
+    int x1 = it.x + w, under = 0;
+    bool step = x1 >= limit;
+    vector<int> nx, ny;
+    for(int k=0; k < xs.size(); k++){
+      if(xs[k] < it.x)
+        nx.push_back(xs[k]), ny.push_back(ys[k]);
+      if(xs[k] < x1)
+        under = ys[k];
+      if(xs[k] == x1)
+        step = true;
+    }
+    nx.push_back(it.x), ny.push_back(it.y + h);
+    if(!step)
+      nx.push_back(x1), ny.push_back(under);
+    for(int k=0; k < xs.size(); k++)
+      if(xs[k] >= x1)
+        nx.push_back(xs[k]), ny.push_back(ys[k]);
+    xs.swap(nx);
+    ys.swap(ny);
+
+    half = max(half, it.x + w);
+    height = max(height, it.y + h);
+  }
+  width = 2 * half;
+}
+
+static void put(Module_Info &m, int left, int bottom, bool turned,
+                int x, int y, int w, int h, bool rotate, bool flip)
+{
+  if(turned){
+    swap(x, y);
+    swap(w, h);
+    rotate = !rotate;
+  }
+  m.x = left + x;
+  m.y = bottom + y;
+  m.rx = m.x + w;
+  m.ry = m.y + h;
+  m.rotate = rotate;
+  m.flip = flip;
+}
+
+void SymmetryIsland::place(const Module_Info &block, Modules_Info &info) const
+{
+  int left = min(block.x, block.rx), bottom = min(block.y, block.ry);
+  bool turned = block.rotate;       // the axis lies across the block
+
+  for(int i=0; i < items.size(); i++){
+    const Item &it = items[i];
+    int w = it.rotate ? it.h : it.w, h = it.rotate ? it.w : it.h;
+    if(it.mate == NIL){
+      put(info[it.mod], left, bottom, turned, half - w / 2, it.y, w, h,
+          false, false);
+      continue;
+    }
+    put(info[it.mod], left, bottom, turned, half + it.x, it.y, w, h,
+        it.rotate, false);
+    put(info[it.mate], left, bottom, turned, half - it.x - w, it.y, w, h,
+        it.rotate, true);
+  }
+}
+
+void SymmetryIsland::save(Blob &b) const
+{
+  b.put(stretch);
+  for(int i=0; i < items.size(); i++){
+    b.put(order[i]);
+    b.put(char(items[i].rotate));
+  }
+}
+
+bool SymmetryIsland::load(Blob &b)
+{
+  vector<char> seen(items.size(), 0);
+  if(!b.get(stretch) || abs(stretch) > max_stretch)
+    return false;
+  for(int i=0; i < items.size(); i++){
+    int k;
+    char rotate;
+    if(!b.get(k) || !b.get(rotate) || k < 0 || k >= items.size() || seen[k])
+      return false;
+    if(rotate && items[i].mate == NIL)
+      return false;
+    seen[k] = 1;
+    order[i] = k;
+    items[i].rotate = rotate;
+  }
+  pack();
+  return true;
+}
@@ -0,0 +1,59 @@
+//---------------------------------------------------------------------------
+#ifndef symmetryH
+#define symmetryH
+//---------------------------------------------------------------------------
+#include <vector>
+#include "fplan.h"
+//---------------------------------------------------------------------------
+class Blob;
+
+/* A symmetry group packed as one block that is symmetric about a vertical
+   axis by construction, as in the ASF-B*-tree: only the right half is
+   packed and the left half is its mirror image. Of a pair, the first module
+   goes right of the axis and its mate mirrored on the left; a
+   self-symmetric module straddles the axis and packs as its right half,
+   against the axis. A self-symmetric module of odd width sits half a unit
+   right of the axis.
+
+   The half is packed bottom-left on a skyline, items in "order", within a
+   width of the square root of its area times 1.25^stretch, so the island
+   keeps near square unless stretched. The island takes the place of its
+   anchor module in the B*-trees, which pack the anchor with the island's
+   width and height.
+*/
+class SymmetryIsland{
+  public:
+    // pairs of a[i] and b[i], then self-symmetric modules
+    void init(const vector<int> &a, const vector<int> &b,
+              const vector<int> &selfs, const Modules &modules);
+    void perturb();             // swaps two items, turns a pair or
+                                // stretches the island, and repacks
+    int  anchor() const { return members[0]; }
+
+    // places the members in "block", where the B*-trees put the anchor
+    void place(const Module_Info &block, Modules_Info &info) const;
+
+    void save(Blob &b) const;
+    bool load(Blob &b);
+
+    vector<int> members;        // modules of the island, anchor first
+    int width, height;
+
+  private:
+    struct Item{
+      int mod, mate;            // mate is NIL for a self-symmetric module
+      int w, h;                 // of the module, not turned
+      int x, y;                 // packed in the right half
+      bool rotate;
+    };
+    void pack();
+
+    vector<Item> items;
+    vector<int>  order;         // packing order of the items
+    int half;                   // width of the right half
+    int stretch;                // of the width the half is packed in
+    static const int max_stretch = 6;
+};
+
+//---------------------------------------------------------------------------
+#endif
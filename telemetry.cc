@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------------
+#include <cstring>
+#include "telemetry.h"
+#include "fplan.h"
+#include "memstat.h"
+//---------------------------------------------------------------------------
+Telemetry telemetry;
+char telemetry_file[256] = "";
+
+bool Telemetry::open(const char *file){
+  close();
+  fs = strcmp(file,"-") ? fopen(file,"w") : stdout;
+  last_temp = last_best = -1e30;
+  best_pending = false;
+  return fs != NULL;
+}
+
+void Telemetry::close(){
+  if(fs && fs != stdout)
+    fclose(fs);
+  else if(fs)
+    fflush(fs);
+  fs = NULL;
+}
+
+void Telemetry::write_best(bool force){
+  double now = wall_seconds();
+  if(!best_pending || (!force && now - last_best < interval))
+    return;
+  fprintf(fs, "{\"event\":\"best\",\"move\":%ld,\"cost\":%.6f,"
+              "\"area\":%.0f,\"wire\":%.0f,\"time\":%.3f}\n",
+          best.move, best.cost, best.area, best.wire, best.wall);
+  last_best = now;
+  best_pending = false;
+}
+
+void Telemetry::new_best(long move, double cost, double area, double wire,
+                         double wall){
+  if(!fs) return;
+  best.move = move;
+  best.cost = cost;
+  best.area = area;
+  best.wire = wire;
+  best.wall = wall;
+  best_pending = true;
+  if(!quiet)
+    write_best(false);
+}
+
+void Telemetry::temp_step(const TempStep &s, float T, float actual_T,
+                          double best_cost, const char *fields){
+  if(!fs) return;
+  write_best(quiet);
+
+  double now = wall_seconds();
+  if(now - last_temp < interval)
+    return;
+  last_temp = now;
+  fprintf(fs, "{\"event\":\"temp\",\"iter\":%d,\"T\":%g,\"actual_T\":%g,"
+              "\"moves\":%d,\"uphill\":%d,\"reject\":%d,\"accept_rate\":%.4f,"
+              "\"cost_mean\":%.6g,\"cost_std\":%.6g,"
+              "\"delta_mean\":%.6g,\"delta_var\":%.6g,\"best_delta\":%.6g,"
+              "\"best\":%.6f,\"rss_kb\":%ld%s%s}\n",
+          s.count, T, actual_T, s.moves, s.uphill, s.reject, s.accept_rate,
+          s.cost_mean, s.std_dev, s.delta_mean, s.delta_var, s.best_delta,
+          best_cost, mem_rss_kb(), fields[0] ? "," : "", fields);
+}
+
+void Telemetry::stop(const char *reason, long moves, long best_move,
+                     double best_cost, double wall){
+  if(!fs) return;
+  write_best(true);
+  fprintf(fs, "{\"event\":\"stop\",\"reason\":\"%s\",\"moves\":%ld,"
+              "\"best_move\":%ld,\"best\":%.6f,\"time\":%.3f}\n",
+          reason, moves, best_move, best_cost, wall);
+  fflush(fs);
+}
@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------------
+#ifndef telemetryH
+#define telemetryH
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include "schedule.h"
+//---------------------------------------------------------------------------
+
+/* Machine-readable record of an anneal, one JSON object per line.
+   Nothing is written unless a file was opened ("-" is stdout).
+
+     {"event":"temp", ...}   statistics of one temperature step
+     {"event":"best", ...}   a new best solution
+     {"event":"stop", ...}   end of the anneal and why it stopped
+
+   "temp" and "best" events are written at most once per "interval"
+   seconds each; a best that is held back is written with the next event,
+   so the last one is never lost. In quiet mode nothing is written inside
+   a temperature step, and the per-step progress lines on stdout are off.
+*/
+class Telemetry{
+  public:
+    Telemetry() : interval(0), quiet(false), fs(NULL) {}
+    ~Telemetry() { close(); }
+
+    bool open(const char *file);
+    void close();
+    bool enabled() const { return fs != NULL; }
+
+    // "fields": more JSON members of the event, from the problem
+    void temp_step(const TempStep &s, float T, float actual_T, double best,
+                   const char *fields = "");
+    void new_best(long move, double cost, double area, double wire,
+                  double wall);
+    void stop(const char *reason, long moves, long best_move, double best,
+              double wall);
+
+    double interval;    // seconds between events of one kind, 0 = all
+    bool   quiet;
+
+  private:
+    void write_best(bool force);
+
+    FILE  *fs;
+    double last_temp, last_best;
+    struct{
+      long   move;
+      double cost, area, wire, wall;
+    } best;
+    bool   best_pending;
+};
+
+extern Telemetry telemetry;
+extern char telemetry_file[256];   // "" = no telemetry
+
+//---------------------------------------------------------------------------
+#endif
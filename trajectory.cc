@@ -0,0 +1,98 @@
+//---------------------------------------------------------------------------
+#include <cstring>
+#include "trajectory.h"
+//---------------------------------------------------------------------------
+char record_file[256] = "";
+char replay_file[256] = "";
+Trajectory trajectory;
+
+static const size_t buffer_records = 65536;
+
+bool Trajectory::create(const char *file, const char *design, uint64_t seed){
+  close();
+  fs = fopen(file, "wb");
+  if(fs == NULL)
+    return false;
+  memset(&header, 0, sizeof(header));
+  header.magic = trajectory_magic;
+  header.version = trajectory_version;
+  header.seed = seed;
+  strncpy(header.design, design, sizeof(header.design)-1);
+  fwrite(&header, sizeof(header), 1, fs);
+
+  buf.resize(buffer_records);
+  fill = 0;
+  writing = true;
+  return true;
+}
+
+bool Trajectory::open(const char *file){
+  close();
+  fs = fopen(file, "rb");
+  if(fs == NULL)
+    return false;
+  if(fread(&header, sizeof(header), 1, fs) != 1 ||
+     header.magic != trajectory_magic ||
+     header.version != trajectory_version){
+    close();
+    return false;
+  }
+  buf.resize(buffer_records);
+  pos = fill = 0;
+  return true;
+}
+
+void Trajectory::close(){
+  if(fs == NULL)
+    return;
+  if(writing){
+    flush();
+    fseek(fs, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fs);
+  }
+  fclose(fs);
+  fs = NULL;
+  writing = false;
+  std::vector<MoveRecord>().swap(buf);
+}
+
+void Trajectory::flush(){
+  if(fill && fwrite(&buf[0], sizeof(MoveRecord), fill, fs) != fill)
+    printf("unable to write the move log\n");
+  fill = 0;
+}
+
+void Trajectory::begin(uint64_t state){
+  memset(&cur, 0, sizeof(cur));
+  cur.state = state;
+}
+
+void Trajectory::note(int op, int mod, int from, int to){
+  cur.op |= op;
+  if(cur.n < 2){
+    cur.mod[cur.n] = mod;
+    cur.from[cur.n] = from;
+    cur.to[cur.n] = to;
+    cur.n++;
+  }
+}
+
+void Trajectory::end(float d_cost, bool accept){
+  cur.d_cost = d_cost;
+  cur.accept = accept;
+  buf[fill++] = cur;
+  header.moves++;
+  if(fill == buf.size())
+    flush();
+}
+
+bool Trajectory::next(MoveRecord &r){
+  if(pos == fill){
+    fill = fread(&buf[0], sizeof(MoveRecord), buf.size(), fs);
+    pos = 0;
+    if(fill == 0)
+      return false;
+  }
+  r = buf[pos++];
+  return true;
+}
@@ -0,0 +1,80 @@
+//---------------------------------------------------------------------------
+#ifndef trajectoryH
+#define trajectoryH
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include <vector>
+#include <stdint.h>
+//---------------------------------------------------------------------------
+extern char record_file[256];   // "" = no recording
+extern char replay_file[256];   // "" = anneal as usual
+
+// Operators of a QB-tree proposal, or'ed together in MoveRecord::op.
+enum MoveOp { MOVE_TO_LEAF=1, MOVE_TO_TREE=2, MOVE_SWAP=4, MOVE_ISLAND=8 };
+
+// One proposed move, 32 bytes in the file.
+struct MoveRecord{
+  uint64_t state;         // random number generator before the proposal
+  float    d_cost;
+  uint8_t  op;            // MoveOp bits of every perturbation tried
+  uint8_t  accept;
+  uint8_t  tries;         // perturbations until the constraints held
+  uint8_t  n;             // entries used below
+  int32_t  mod[2];        // first modules moved,
+  int16_t  from[2], to[2];// and the quad leaves of their old and new trees
+};
+
+struct TrajectoryHeader{
+  uint32_t magic, version;
+  uint64_t seed;
+  char     design[64];
+  double   start_cost;    // cost the anneal started from
+  int64_t  moves;
+};
+
+const uint32_t trajectory_magic   = 0x52544251;   // "QBTR"
+const uint32_t trajectory_version = 1;
+
+/* Binary log of every move the annealer proposes. Records go to a fixed
+   buffer that is written out whenever it fills, so a run of any length
+   records in constant memory; the header is completed on close().
+
+   Replaying a log starts each proposal from its recorded random state and
+   takes the recorded decision, so the same moves are packed, costed and
+   recovered with no schedule or acceptance test in between.
+*/
+class Trajectory{
+  public:
+    Trajectory() : fs(NULL), writing(false) {}
+    ~Trajectory() { close(); }
+
+    bool create(const char *file, const char *design, uint64_t seed);
+    bool open(const char *file);              // for replay, reads header
+    void close();
+    bool recording() const { return writing; }
+
+    // recording, called by the annealer and the QB-tree perturbation
+    void begin(uint64_t state);
+    void perturbation() { if(cur.tries < 255) cur.tries++; }
+    void note(int op, int mod, int from, int to);
+    void end(float d_cost, bool accept);
+
+    // replay
+    bool next(MoveRecord &r);
+
+    TrajectoryHeader header;
+
+  private:
+    void flush();
+
+    FILE  *fs;
+    bool   writing;
+    MoveRecord cur;
+    std::vector<MoveRecord> buf;
+    size_t pos, fill;
+};
+
+extern Trajectory trajectory;
+
+//---------------------------------------------------------------------------
+#endif
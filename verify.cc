@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------
+#include <set>
+#include <list>
+#include <climits>
+#include <algorithm>
+#include "verify.h"
+//---------------------------------------------------------------------------
+
+static RECT normal(const RECT &r){
+  RECT n;
+  n.left   = min(r.left, r.right);
+  n.right  = max(r.left, r.right);
+  n.bottom = min(r.bottom, r.top);
+  n.top    = max(r.bottom, r.top);
+  return n;
+}
+
+struct Edge{
+  long x;
+  bool open;
+  int  id;
+  bool operator<(const Edge &e) const {
+    // rects that only touch do not overlap: close before open
+    return x < e.x || (x == e.x && open < e.open);
+  }
+};
+
+// The rects cut by the sweep line, as a segment tree over the y values:
+// slot s is [ys[s], ys[s+1]), and a rect is held by the O(log n) nodes
+// whose slots make up [bottom, top), so those holding a y all lie on one
+// path from the root.
+class StabTree{
+public:
+  StabTree(const vector<long> &ys, int rects)
+    : ys(ys), slots(ys.size() - 1), held(4 * slots), where(rects) {}
+
+  void insert(int id, long bottom, long top){
+    insert(1, 0, slots, slot(bottom), slot(top), id);
+  }
+
+  void erase(int id){
+    for(int i=0; i < where[id].size(); i++)
+      held[where[id][i].first].erase(where[id][i].second);
+    where[id].clear();
+  }
+
+  // appends the rects with bottom <= y < top
+  void stab(long y, vector<int> &found) const {
+    int s = slot(y), node = 1, lo = 0, hi = slots;
+    while(true){
+      found.insert(found.end(), held[node].begin(), held[node].end());
+      if(hi - lo == 1)
+        return;
+      int mid = (lo + hi) / 2;
+      if(s < mid){ node = 2 * node; hi = mid; }
+      else       { node = 2 * node + 1; lo = mid; }
+    }
+  }
+
+private:
+  int slot(long y) const {
+    return lower_bound(ys.begin(), ys.end(), y) - ys.begin();
+  }
+
+  void insert(int node, int lo, int hi, int from, int to, int id){
+    if(to <= lo || hi <= from)
+      return;
+    if(from <= lo && hi <= to){
+      held[node].push_front(id);
+      where[id].push_back(make_pair(node, held[node].begin()));
+      return;
+    }
+    int mid = (lo + hi) / 2;
+    insert(2 * node, lo, mid, from, to, id);
+    insert(2 * node + 1, mid, hi, from, to, id);
+  }
+
+  vector<long> ys;
+  int slots;
+  vector<list<int> > held;
+  vector<vector<pair<int, list<int>::iterator> > > where;
+};
+
+int find_overlaps(const vector<RECT> &mods, const vector<RECT> &ppms,
+                  const RECT &outline, vector<PlacementIssue> &issues)
+{
+  int found = issues.size();
+  int n = mods.size();
+  vector<RECT> r(n + ppms.size());
+  vector<Edge> edges;
+  vector<long> ys;
+
+  RECT box = normal(outline);
+  for(int i=0; i < r.size(); i++){
+    r[i] = normal(i < n ? mods[i] : ppms[i-n]);
+    if(r[i].left == r[i].right || r[i].bottom == r[i].top)
+      continue;
+    Edge open = { r[i].left, true, i }, close = { r[i].right, false, i };
+    edges.push_back(open);
+    edges.push_back(close);
+    ys.push_back(r[i].bottom);
+    ys.push_back(r[i].top);
+
+    if(i < n && (r[i].left < box.left || r[i].right > box.right ||
+                 r[i].bottom < box.bottom || r[i].top > box.top)){
+      long w = max(0L, min(r[i].right, box.right) - max(r[i].left, box.left));
+      long h = max(0L, min(r[i].top, box.top) - max(r[i].bottom, box.bottom));
+      PlacementIssue p = { OUTSIDE_OUTLINE, i, NIL,
+        (r[i].right - r[i].left) * (r[i].top - r[i].bottom) - w * h };
+      issues.push_back(p);
+    }
+  }
+  sort(edges.begin(), edges.end());
+  if(edges.empty())
+    return issues.size() - found;
+  sort(ys.begin(), ys.end());
+  ys.erase(unique(ys.begin(), ys.end()), ys.end());
+
+  // An active [b',t') overlaps [b,t) when b' <= b < t', found by stabbing
+  // the tree at b, or when b < b' < t, a range of the set by bottom.
+  StabTree stabbed(ys, r.size());
+  set<pair<long,int> > active;
+  vector<int> over;
+  for(int e=0; e < edges.size(); e++){
+    int i = edges[e].id;
+    pair<long,int> key(r[i].bottom, i);
+    if(!edges[e].open){
+      active.erase(key);
+      stabbed.erase(i);
+      continue;
+    }
+
+    over.clear();
+    stabbed.stab(r[i].bottom, over);
+    for(set<pair<long,int> >::iterator it =
+          active.upper_bound(make_pair(r[i].bottom, INT_MAX));
+        it != active.end() && it->first < r[i].top; ++it)
+      over.push_back(it->second);
+
+    for(int o=0; o < over.size(); o++){
+      int j = over[o];
+      if(i >= n && j >= n)
+        continue;
+      int a = min(i, j), b = max(i, j);
+      long w = min(r[i].right, r[j].right) - r[i].left;
+      long h = min(r[i].top, r[j].top) - max(r[i].bottom, r[j].bottom);
+      PlacementIssue p = { b < n ? OVERLAP_MODULE : OVERLAP_PPM, a,
+                           b < n ? b : b - n, w * h };
+      issues.push_back(p);
+    }
+    active.insert(key);
+    stabbed.insert(i, r[i].bottom, r[i].top);
+  }
+  return issues.size() - found;
+}
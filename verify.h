@@ -0,0 +1,31 @@
+//---------------------------------------------------------------------------
+#ifndef verifyH
+#define verifyH
+//---------------------------------------------------------------------------
+#include <vector>
+#include "qbtree.h"
+//---------------------------------------------------------------------------
+
+enum PlacementIssueKind { OVERLAP_MODULE=0, OVERLAP_PPM, OUTSIDE_OUTLINE };
+
+struct PlacementIssue{
+  int  kind;      // PlacementIssueKind
+  int  a;         // module
+  int  b;         // other module, pre-placed rect, or NIL for the outline
+  long area;      // area shared, or area outside the outline
+};
+
+/* Sweep-line check of a placement: every overlap of two modules or of a
+   module and a pre-placed rect, and every module reaching out of the
+   outline, in O((n + k) log n) for n rects and k issues; the rects cut by
+   the sweep line are queried by their y ranges, so tall rects cost no
+   more than others. Pre-placed rects that overlap each other are not
+   issues but still count in k. Rects may give their corners in any order;
+   empty ones are skipped. Returns the issues found, which are appended to
+   "issues".
+*/
+int find_overlaps(const vector<RECT> &mods, const vector<RECT> &ppms,
+                  const RECT &outline, vector<PlacementIssue> &issues);
+
+//---------------------------------------------------------------------------
+#endif
@@ -0,0 +1,338 @@
+// Synthetic design generator: writes a YAL design and its _constraint file
+// for scaling tests. The output depends only on the options and the seed.
+//
+//   yalgen <output> [--modules=N] [--pads=M] [--seed=S]
+//          [--aspect=LO,HI] [--area=uniform|lognormal|power]
+//          [--area-mean=A] [--area-spread=S] [--rent=P] [--pins=K]
+//          [--whitespace=F] [--constraints=kind:count,...]
+//
+// Modules are hard blocks whose areas follow the chosen distribution
+// around area-mean, with aspect ratios log-uniform in [LO,HI]. Nets follow
+// Rent's rule loosely: with exponent P, net degrees have a power-law tail
+// d^-(1+1/P) and the modules of a net mostly lie close together in module
+// order, spanning up to N^(U^(1/P)) for uniform U. Unless --pads is given
+// there are 2.5*N^P pads, spread over the outline and tied to random nets.
+//
+// Constraint kinds: sym, prox, minsep, maxsep, range, cltob, boundary,
+// fixed, variant. A count ending in % is taken relative to N.
+
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "fplan.h"
+//---------------------------------------------------------------------------
+
+static double uniform()
+{
+  return (rand_int(1<<30) + 0.5) / double(1<<30);
+}
+
+static double gaussian()
+{
+  return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+struct GenModule{
+  int width, height;
+  vector<int> pins;     // net of each pin, in IOLIST order
+};
+
+struct Options{
+  int    modules, pads, pins;
+  double aspect_lo, aspect_hi;
+  char   area[20];
+  double area_mean, area_spread;
+  double rent, whitespace;
+  char   constraints[200];
+};
+
+static int module_area(const Options &o)
+{
+  double a;
+  if(!strcmp(o.area, "uniform")){
+    double s = min(o.area_spread, 0.95);
+    a = o.area_mean * (1 + s * (2 * uniform() - 1));
+  }
+  else if(!strcmp(o.area, "power"))     // Pareto with the given mean
+  {
+    double alpha = 1 + 1 / max(o.area_spread, 0.01);
+    a = o.area_mean * (alpha - 1) / alpha * pow(uniform(), -1 / alpha);
+  }
+  else{                                 // lognormal with the given mean
+    double s = o.area_spread;
+    a = o.area_mean * exp(s * gaussian() - s * s / 2);
+  }
+  return max(a, 4.0);
+}
+
+// degree >= 2 with P(d) ~ d^-(1+1/rent), at most "limit"
+static int net_degree(double rent, int limit)
+{
+  double alpha = 1 / rent;
+  int d = int(2 * pow(uniform(), -1 / alpha));
+  return max(2, min(d, limit));
+}
+
+static int count_of(const char *spec, const char *kind, int n)
+{
+  const char *p = spec;
+  int len = strlen(kind);
+  while(p && *p){
+    if(!strncmp(p, kind, len) && p[len] == ':'){
+      const char *v = p + len + 1;
+      int c = atoi(v);
+      while(*v >= '0' && *v <= '9') v++;
+      if(*v == '%')
+        c = int(double(c) * n / 100 + 0.5);
+      return c;
+    }
+    p = strchr(p, ',');
+    if(p) p++;
+  }
+  return 0;
+}
+
+// distinct random modules for one constraint kind
+static vector<int> pick(vector<char> &used, int count)
+{
+  vector<int> r;
+  int n = used.size();
+  for(int tries=0; r.size() < count && tries < 20 * n; tries++){
+    int m = rand_int(n);
+    if(used[m]) continue;
+    used[m] = 1;
+    r.push_back(m);
+  }
+  return r;
+}
+
+static void write_constraints(const char *file, const Options &o, int side)
+{
+  FILE *fs = fopen(file, "w");
+  if(fs == NULL){
+    printf("unable to open file: %s\n", file);
+    exit(1);
+  }
+  int n = o.modules;
+  const char *spec = o.constraints;
+  const char *sides[] = { "TOP", "BOTTOM", "LEFT", "RIGHT" };
+  vector<char> used(n, 0);
+  vector<int> m;
+
+  fprintf(fs, "SYMMETRY\n");
+  m = pick(used, 2 * count_of(spec, "sym", n));
+  for(int i=0; i+1 < m.size(); i += 2)
+    fprintf(fs, "[m%d,m%d];\n", m[i], m[i+1]);
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "PROXIMITY\n");
+  m = pick(used, count_of(spec, "prox", n));
+  if(m.size() > 1){
+    fprintf(fs, "[");
+    for(int i=0; i < m.size(); i++)
+      fprintf(fs, "%sm%d", i ? "," : "", m[i]);
+    fprintf(fs, "];\n");
+  }
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "MINIMUM_SEPARATION\n");
+  m = pick(used, count_of(spec, "minsep", n));
+  for(int i=0; i < m.size(); i++)
+    fprintf(fs, "m%d %d;\n", m[i], 10 + rand_int(side / 50 + 1));
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "MAXIMUM_SEPARATION\n");
+  m = pick(used, 2 * count_of(spec, "maxsep", n));
+  for(int i=0; i+1 < m.size(); i += 2)
+    fprintf(fs, "[m%d,m%d] %d;\n", m[i], m[i+1], side / 4 + rand_int(side / 4 + 1));
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "RANGE\n");
+  m = pick(used, count_of(spec, "range", n));
+  for(int i=0; i < m.size(); i++)
+    fprintf(fs, "m%d %s %d;\n", m[i], sides[rand_int(4)], side / 5 + rand_int(side / 5 + 1));
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "CLOSE_TO_BOUNDARY\n");
+  m = pick(used, count_of(spec, "cltob", n));
+  for(int i=0; i < m.size(); i++)
+    fprintf(fs, "m%d %d;\n", m[i], side / 5 + rand_int(side / 5 + 1));
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "BOUNDARY\n");
+  m = pick(used, count_of(spec, "boundary", n));
+  for(int i=0; i < m.size(); i++)
+    fprintf(fs, "m%d;\n", m[i]);
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "FIXED_BOUNDARY\n");
+  m = pick(used, count_of(spec, "fixed", n));
+  for(int i=0; i < m.size(); i++)
+    fprintf(fs, "m%d %d;\n", m[i], rand_int(2));
+  fprintf(fs, "END\n\n");
+
+  fprintf(fs, "VARIANT\n");
+  m = pick(used, count_of(spec, "variant", n));
+  for(int i=0; i < m.size(); i++)
+    fprintf(fs, "m%d [%.2f,%.2f,%.2f];\n", m[i], 0.8 + 0.1 * rand_int(3),
+            1.1 + 0.1 * rand_int(3), 1.5 + 0.1 * rand_int(3));
+  fprintf(fs, "END\n");
+  fclose(fs);
+}
+
+static void usage()
+{
+  printf("Usage: yalgen <output> [--modules=N] [--pads=M] [--seed=S]\n");
+  printf("        [--aspect=LO,HI] [--area=uniform|lognormal|power]\n");
+  printf("        [--area-mean=A] [--area-spread=S] [--rent=P] [--pins=K]\n");
+  printf("        [--whitespace=F] [--constraints=kind:count,...]\n");
+  printf("  constraint kinds: sym prox minsep maxsep range cltob boundary\n");
+  printf("  fixed variant; a count ending in %% is relative to N\n");
+}
+
+int main(int argc, char **argv)
+{
+  Options o;
+  o.modules = 100;
+  o.pads = -1;
+  o.pins = 4;
+  o.aspect_lo = 1/3.0;
+  o.aspect_hi = 3;
+  strcpy(o.area, "lognormal");
+  o.area_mean = 20000;
+  o.area_spread = 0.8;
+  o.rent = 0.6;
+  o.whitespace = 0.15;
+  strcpy(o.constraints, "prox:4,minsep:1,maxsep:1,range:1,cltob:2,"
+                        "boundary:2,fixed:1,variant:1");
+  uint64_t seed = 1;
+  const char *out = NULL;
+
+  for(int i=1; i < argc; i++){
+    char arg[200], *value;
+    strncpy(arg, argv[i], sizeof(arg)-1);
+    arg[sizeof(arg)-1] = 0;
+    if(strncmp(arg, "--", 2)){
+      out = argv[i];
+      continue;
+    }
+    value = strchr(arg, '=');
+    if(value) *value++ = 0;
+    else value = (char*)"";
+
+    if(!strcmp(arg, "--modules"))           o.modules = atoi(value);
+    else if(!strcmp(arg, "--pads"))         o.pads = atoi(value);
+    else if(!strcmp(arg, "--pins"))         o.pins = atoi(value);
+    else if(!strcmp(arg, "--seed"))         seed = strtoull(value, NULL, 10);
+    else if(!strcmp(arg, "--aspect"))
+      sscanf(value, "%lf,%lf", &o.aspect_lo, &o.aspect_hi);
+    else if(!strcmp(arg, "--area"))
+      strncpy(o.area, value, sizeof(o.area)-1);
+    else if(!strcmp(arg, "--area-mean"))    o.area_mean = atof(value);
+    else if(!strcmp(arg, "--area-spread"))  o.area_spread = atof(value);
+    else if(!strcmp(arg, "--rent"))         o.rent = atof(value);
+    else if(!strcmp(arg, "--whitespace"))   o.whitespace = atof(value);
+    else if(!strcmp(arg, "--constraints"))
+      strncpy(o.constraints, value, sizeof(o.constraints)-1);
+    else{
+      usage();
+      return 1;
+    }
+  }
+  if(out == NULL || o.modules < 2 || o.rent <= 0 || o.rent >= 1 ||
+     o.aspect_lo <= 0 || o.aspect_hi < o.aspect_lo){
+    usage();
+    return 1;
+  }
+
+  int n = o.modules;
+  if(o.pads < 0)
+    o.pads = int(2.5 * pow(n, o.rent) + 0.5);
+  rand_seed(seed);
+
+  // modules
+  vector<GenModule> mods(n);
+  double total = 0;
+  for(int i=0; i < n; i++){
+    double a = module_area(o);
+    double r = o.aspect_lo * pow(o.aspect_hi / o.aspect_lo, uniform());
+    mods[i].width  = max(1, int(sqrt(a * r) + 0.5));
+    mods[i].height = max(1, int(sqrt(a / r) + 0.5));
+    total += double(mods[i].width) * mods[i].height;
+  }
+
+  // nets: a random center and mostly nearby modules
+  int nets = 0;
+  long pins = 0, want = long(o.pins) * n;
+  while(pins < want){
+    int d = net_degree(o.rent, min(n, 64));
+    int center = rand_int(n);
+    for(int j=0; j < d; j++){
+      int span = int(pow(double(n), pow(uniform(), 1 / o.rent)));
+      int m = j == 0 ? center : center + (rand_bool() ? span : -span);
+      m = ((m % n) + n) % n;
+      mods[m].pins.push_back(nets);
+    }
+    pins += d;
+    nets++;
+  }
+  for(int i=0; i < n; i++)              // every module takes part
+    if(mods[i].pins.empty())
+      mods[i].pins.push_back(rand_int(nets));
+
+  int side = int(sqrt(total * (1 + o.whitespace)) + 0.5);
+
+  // YAL
+  FILE *fs = fopen(out, "w");
+  if(fs == NULL){
+    printf("unable to open file: %s\n", out);
+    return 1;
+  }
+  for(int i=0; i < n; i++){
+    GenModule &m = mods[i];
+    fprintf(fs, "MODULE m%d;\n TYPE GENERAL;\n", i);
+    fprintf(fs, " DIMENSIONS %d 0 %d %d 0 %d 0 0;\n IOLIST;\n",
+            m.width, m.width, m.height, m.height);
+    for(int j=0; j < m.pins.size(); j++){
+      // on a random side
+      int x, y;
+      if(rand_bool()){ x = rand_int(m.width+1);  y = rand_bool() ? 0 : m.height; }
+      else           { y = rand_int(m.height+1); x = rand_bool() ? 0 : m.width; }
+      fprintf(fs, "  P_%d B %d %d 1 METAL2;\n", j, x, y);
+    }
+    fprintf(fs, " ENDIOLIST;\nENDMODULE;\n");
+  }
+
+  fprintf(fs, "MODULE design;\n TYPE PARENT;\n");
+  fprintf(fs, " DIMENSIONS %d 0 %d %d 0 %d 0 0;\n IOLIST;\n",
+          side, side, side, side);
+  for(int i=0; i < o.pads; i++){
+    int t = rand_int(4 * side), x, y;
+    if(t < side)          x = t,            y = 0;
+    else if(t < 2 * side) x = side,         y = t - side;
+    else if(t < 3 * side) x = 3 * side - t, y = side;
+    else                  x = 0,            y = 4 * side - t;
+    fprintf(fs, "  n%d PB %d %d 1 METAL2;\n", rand_int(nets), x, y);
+  }
+  fprintf(fs, " ENDIOLIST;\n NETWORK;\n");
+  for(int i=0; i < n; i++){
+    fprintf(fs, "  C_%d m%d", i, i);
+    for(int j=0; j < mods[i].pins.size(); j++)
+      fprintf(fs, " n%d", mods[i].pins[j]);
+    fprintf(fs, ";\n");
+  }
+  fprintf(fs, " ENDNETWORK;\nENDMODULE;\n");
+  fclose(fs);
+
+  char cfile[256];
+  snprintf(cfile, sizeof(cfile), "%s_constraint", out);
+  write_constraints(cfile, o, side);
+
+  printf("%s: %d modules, %d nets, %ld pins, %d pads, outline %d x %d\n",
+         out, n, nets, pins, o.pads, side, side);
+  return 0;
+}